@@ -13,9 +13,14 @@
 #include "Resources.h"
 
 #include "WarGame.h"
+#include "HexPicking.h"
+#include "FrameScheduler.h"
+#include "RenderList.h"
 #include "StateManager.h"
 
 #include <cassert>
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
 
 using namespace ci;
 using namespace ci::app;
@@ -84,11 +89,26 @@ public:
     void mouseDrag(MouseEvent event);
     void mouseWheel(MouseEvent event);
 
+    //  Input waits for the simulation to finish its ticks
+    void handleKeyDown(KeyEvent event);
+    void handleMouseMove(MouseEvent event);
+    void handleMouseDown(MouseEvent event);
+    void handleMouseUp(MouseEvent event);
+    void handleMouseDrag(MouseEvent event);
+    void handleMouseWheel(MouseEvent event);
+
+    //  Run a frame's simulation ticks, on the pipeline's worker
+    void tick(int ticks);
+
     GuiController mGui;
     GuiFactoryPtr mFactory;
     GuiConsolePtr mConsole;
 
     MousePtr      mMouse;
+    HexPickerPtr  mPicker;
+
+    //  Simulation ticks and the frame rate
+    FrameScheduler mScheduler;
 
     //  Game stuff
     HexGrid       mHexGrid;
@@ -97,6 +117,12 @@ public:
 
     WarGame          mWarGame;
     StateManagerPtr  mStateManager;
+
+    //  Input events since the last frame
+    vector<boost::function<void ()> > mInput;
+
+    //  Last, so its worker stops before anything it ticks goes
+    RenderPipelinePtr mPipeline;
 };
 
 const int WINDOW_WIDTH = 1280;
@@ -105,24 +131,29 @@ const int WINDOW_HEIGHT = 720;
 void HexApp::prepareSettings( Settings *settings )
 {
     settings->setWindowSize(WINDOW_WIDTH, WINDOW_HEIGHT);
-    settings->setFrameRate(60.0f);
+    settings->setFrameRate(float(mScheduler.getFrameRate()));
 }
 
 void HexApp::setup()
 {
     Vec2i wsize(getWindowSize());
 
+    //  Everything draws into the pipeline's render lists
+    mPipeline  = RenderPipelinePtr(new RenderPipeline(RenderBackendPtr(new GlRenderBackend())));
+    mGui.setBackend(mPipeline->getRecorder());
+
     mHexMap    = HexMapPtr(new HexMap(mHexGrid, 64, 32));
-    mHexRender = HexRenderPtr(new HexRender(*mHexMap));
+    mHexRender = HexRenderPtr(new HexRender(*mHexMap, mPipeline->getRecorder()));
     mHexRender->setup(wsize);
     mMouse = MousePtr(new Mouse(wsize));
+    mPicker = HexPickerPtr(new HexPicker(*mHexRender, mHexMap->hexGrid(), *mMouse));
     mFactory = GuiFactoryPtr(new GuiFactory(mGui));
     mConsole = mFactory->createConsole(20, 15.0f);
 
     //  Set console to full window width
     mConsole->setWidth(mMouse->getWindowSize().x);
 
-    SharedPtr shared(new Shared(*mHexMap, mHexMap->hexGrid(), *mHexRender, mGui, *mFactory, *mMouse, mWarGame, mConsole));
+    SharedPtr shared(new Shared(*mHexMap, mHexMap->hexGrid(), *mHexRender, mGui.getBackend(), mGui, *mFactory, *mMouse, *mPicker, mScheduler, mWarGame, mConsole));
 
     //  XXX hack -- required to pass the Shared object to Gui callbacks
     mGui.setShared(shared);
@@ -137,15 +168,47 @@ void HexApp::setup()
     mWarGame.addPlayer("Zen");
 }
 
+//  Frame N is recorded here, once the ticks run during frame N-1's draw are
+//  done, then handed to draw() while the ticks for frame N+1 run
 void HexApp::update()
 {
+    mPipeline->wait();
+
+    for (vector<boost::function<void ()> >::iterator it = mInput.begin(); it != mInput.end(); ++it) {
+        (*it)();
+    }
+    mInput.clear();
+
+    if (float(mScheduler.getFrameRate()) != getFrameRate()) {
+        setFrameRate(float(mScheduler.getFrameRate()));
+    }
+
+    mPicker->update();
     mStateManager->update();
+    //  the console takes in what was logged even while hidden, or the log fills
+    mConsole->drainLog();
     mGui.update();
+
+    mPipeline->recordScene();
+    mStateManager->draw();
+    mPipeline->recordGui();
+    mGui.draw();
+    mPipeline->swap();
+
+    //  The simulation keeps to the tick rate however long frames take
+    mPipeline->simulate(boost::bind(&HexApp::tick, this, mScheduler.beginFrame(getElapsedSeconds())));
+}
+
+void HexApp::tick(int ticks)
+{
+    for (int i=0; i < ticks; ++i) {
+        mStateManager->tick(mScheduler.getTickSeconds());
+    }
 }
 
 void HexApp::draw()
 {	
-    mStateManager->draw();
+    mPipeline->submitScene();
 
     //  Draw gui
     glDisable(GL_LIGHTING);
@@ -155,11 +218,41 @@ void HexApp::draw()
 
     gl::pushMatrices();
     gl::setMatricesWindow(getWindowSize());
-    mGui.draw();
+    mPipeline->submitGui();
     gl::popMatrices();
 }
 
-void HexApp::keyDown( KeyEvent event )
+void HexApp::keyDown(KeyEvent event)
+{
+    mInput.push_back(boost::bind(&HexApp::handleKeyDown, this, event));
+}
+
+void HexApp::mouseMove(MouseEvent event)
+{
+    mInput.push_back(boost::bind(&HexApp::handleMouseMove, this, event));
+}
+
+void HexApp::mouseDown(MouseEvent event)
+{
+    mInput.push_back(boost::bind(&HexApp::handleMouseDown, this, event));
+}
+
+void HexApp::mouseUp(MouseEvent event)
+{
+    mInput.push_back(boost::bind(&HexApp::handleMouseUp, this, event));
+}
+
+void HexApp::mouseDrag(MouseEvent event)
+{
+    mInput.push_back(boost::bind(&HexApp::handleMouseDrag, this, event));
+}
+
+void HexApp::mouseWheel(MouseEvent event)
+{
+    mInput.push_back(boost::bind(&HexApp::handleMouseWheel, this, event));
+}
+
+void HexApp::handleKeyDown( KeyEvent event )
 {
     // XXX GUI should intercept key events too
     if (!mGui.keyDown(event)) {
@@ -167,14 +260,14 @@ void HexApp::keyDown( KeyEvent event )
     }
 }
 
-void HexApp::mouseMove(MouseEvent event)
+void HexApp::handleMouseMove(MouseEvent event)
 {
     mGui.mouseMove(event);
     mMouse->mouseMove(event);
     mStateManager->getActiveState()->mouseMove(event);
 }
 
-void HexApp::mouseDown(MouseEvent event)
+void HexApp::handleMouseDown(MouseEvent event)
 {
     if (!mGui.mouseDown(event)) {
         mMouse->mouseDown(event);
@@ -182,7 +275,7 @@ void HexApp::mouseDown(MouseEvent event)
     }
 }
 
-void HexApp::mouseUp(MouseEvent event)
+void HexApp::handleMouseUp(MouseEvent event)
 {
     if (!mGui.mouseUp(event)) {
         mMouse->mouseUp(event);
@@ -190,14 +283,14 @@ void HexApp::mouseUp(MouseEvent event)
     }
 }
 
-void HexApp::mouseDrag(MouseEvent event)
+void HexApp::handleMouseDrag(MouseEvent event)
 {
     mMouse->mouseDrag(event);
     mGui.mouseDrag(event);
     mStateManager->getActiveState()->mouseDrag(event);
 }
 
-void HexApp::mouseWheel(MouseEvent event)
+void HexApp::handleMouseWheel(MouseEvent event)
 {
     mMouse->mouseWheel(event);
     mGui.mouseWheel(event);
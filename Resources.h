@@ -5,3 +5,8 @@
 #define RES_FRAG		CINDER_RESOURCE( ../data/, frag.glsl, 129, GLSL )
 #define RES_TEXTURE_PNG CINDER_RESOURCE( ../data/, texture.png, 130, PNG )
 #define RES_LAGUNA_PRESA_PNG  CINDER_RESOURCE( ../data/, LagunaPresa.png, 131, PNG )
+#define RES_HEX_VERT    CINDER_RESOURCE( ../data/, hex_vert.glsl, 132, GLSL )
+#define RES_HEX_FRAG    CINDER_RESOURCE( ../data/, hex_frag.glsl, 133, GLSL )
+#define RES_HEX_LOD_VERT CINDER_RESOURCE( ../data/, hex_lod_vert.glsl, 134, GLSL )
+#define RES_HEX_LOD_FRAG CINDER_RESOURCE( ../data/, hex_lod_frag.glsl, 135, GLSL )
+#define RES_HEX_CHUNK_VERT CINDER_RESOURCE( ../data/, hex_chunk_vert.glsl, 136, GLSL )
@@ -0,0 +1,96 @@
+#include "cinder/Timer.h"
+
+#include "WarGame.h"
+#include "RenderBackend.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace ci;
+using namespace netphy;
+
+//  Renders the hex map through a RecordingRenderBackend, so no GL context
+//  or GPU is needed, and reports what a frame submits and the CPU time it
+//  takes for several map sizes, camera heights and draw paths.
+//
+//  Built by vc9/renderbench.vcproj from the map and render sources alone,
+//  linking only Cinder.  Cinder 0.8 has no Linux build and HexRender draws
+//  through its gl and camera types, so the bench doesn't build on Linux and
+//  has no CI target.  Figures are only meaningful from this build; none are
+//  recorded in the tree.
+//
+//  usage: renderbench [frames]
+
+static const int MapSizes[] = { 256, 1024, 4096 };
+static const float Heights[] = { 30.0f, 80.0f, 200.0f };
+static const Vec2i WindowSize(1280, 800);
+
+//  Scatter some land about so the map isn't one colour
+static void fillMap(HexMap& map)
+{
+    const Vec2i size = map.getSize();
+    srand(1);
+    for (int y=0; y < size.y; ++y) {
+        for (int x=0; x < size.x; ++x) {
+            if (rand() % 3 == 0) {
+                map.at(HexCoord(x, y)).setLand(rand() % 5);
+            }
+        }
+    }
+}
+
+static void bench(HexMap& map, bool instancing, float height, int frames)
+{
+    boost::shared_ptr<RecordingRenderBackend> backend(new RecordingRenderBackend(instancing));
+    HexRender render(map, backend);
+    render.setup(WindowSize);
+
+    //  straight down over the middle of the map, where it stays
+    const Vec2i size = map.getSize();
+    const Vec3f middle = map.hexGrid().HexToWorld(HexCoord(size.x / 2, size.y / 2));
+    Vec3f eye(middle.x, middle.y, height);
+    render.getCamera().lookAt(eye, Vec3f(eye.x, eye.y, 0));
+    render.jumpCamera(eye);
+
+    //  the first frame uploads whatever it draws from
+    backend->resetStats();
+    render.update();
+    render.drawHexes();
+    const size_t firstBytes = backend->getStats().bytesUploaded;
+
+    backend->resetStats();
+    Timer timer(true);
+    for (int i=0; i < frames; ++i) {
+        render.update();
+        render.drawHexes();
+    }
+    const double ms = timer.getSeconds() * 1000.0 / frames;
+
+    const RenderStats& stats = backend->getStats();
+    printf("%5d x %-5d %-9s %6.0f %8d %8d %11lu %10lu %12lu %9.3f\n", size.x, size.y,
+           instancing ? "instanced" : "chunks", height,
+           stats.drawCalls / frames, stats.stateChanges / frames, (unsigned long) (stats.vertices / frames),
+           (unsigned long) (stats.bytesUploaded / frames), (unsigned long) firstBytes, ms);
+}
+
+int main(int argc, char* argv[])
+{
+    const int frames = argc > 1 ? std::max(atoi(argv[1]), 1) : 100;
+
+    printf("%-13s %-9s %6s %8s %8s %11s %10s %12s %9s\n", "map", "path", "height",
+           "draws", "states", "vertices", "bytes", "first bytes", "cpu ms");
+    for (size_t s=0; s < sizeof(MapSizes) / sizeof(MapSizes[0]); ++s) {
+        HexGrid grid;
+        HexMap map(grid, MapSizes[s], MapSizes[s]);
+        fillMap(map);
+
+        for (int instancing=0; instancing < 2; ++instancing) {
+            for (size_t h=0; h < sizeof(Heights) / sizeof(Heights[0]); ++h) {
+                bench(map, instancing != 0, Heights[h], frames);
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,14 @@
+//  Chunk mesh hexes, already in world space.  hexCell holds how near the
+//  vertex is to the hex's centre and the cell's marks, as normalized bytes.
+attribute vec2 hexCell;
+
+varying float edge;
+varying float marks;
+
+void main()
+{
+	edge = hexCell.x;
+	marks = hexCell.y * 255.0;
+	gl_FrontColor = gl_Color;
+	gl_Position = ftransform();
+}
@@ -0,0 +1,31 @@
+//  Hex fill with its outline and marks.  edge falls from 1 at the hex's
+//  centre to 0 on its edges, marks are HexRender's marks for the cell.
+uniform vec4 outlineColor;
+uniform vec4 selectColor;
+
+varying float edge;
+varying float marks;
+
+void main()
+{
+	vec4 color = gl_Color;
+	float cell = floor(marks + 0.5);
+
+	//  highlighted cells are darkened
+	if (mod(cell, 2.0) >= 1.0) {
+		color.rgb *= 0.5;
+	}
+
+	//  lines stay the same number of pixels wide at any zoom, neighbours 
+	//  each draw half of the outline between them
+	float pixel = fwidth(edge);
+	float outline = 1.0 - smoothstep(0.0, pixel, edge);
+	color.rgb = mix(color.rgb, outlineColor.rgb, outline * outlineColor.a);
+
+	if (cell >= 2.0) {
+		float select = 1.0 - smoothstep(2.0 * pixel, 3.0 * pixel, edge);
+		color.rgb = mix(color.rgb, selectColor.rgb, select * selectColor.a);
+	}
+
+	gl_FragColor = color;
+}
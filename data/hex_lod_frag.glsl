@@ -0,0 +1,37 @@
+//  Zoomed out map, each fragment finds the hex it lies in and takes its
+//  colour from a texture holding one texel per cell.  Texels with no alpha
+//  are cells without storage on a chunked map and aren't drawn.
+uniform sampler2D colors;
+uniform vec2      spacing;
+uniform vec2      mapSize;
+
+varying vec2 world;
+
+void main()
+{
+	//  HexGrid::WorldToHex, round cube coordinates to the nearest hex
+	float x = world.x / spacing.x;
+	float y = world.y / spacing.y - 0.5 * x;
+	vec3 cube = vec3(x, y, -x - y);
+	vec3 hex = floor(cube + 0.5);
+	vec3 error = abs(hex - cube);
+	float s = hex.x + hex.y + hex.z;
+	if (error.x >= error.y && error.x >= error.z) {
+		hex.x -= s;
+	}
+	else if (error.y >= error.z) {
+		hex.y -= s;
+	}
+
+	//  back to column and row, odd columns sit half a row higher
+	vec2 cell = vec2(hex.x, hex.y + floor(hex.x * 0.5));
+	if (cell.x < 0.0 || cell.y < 0.0 || cell.x >= mapSize.x || cell.y >= mapSize.y) {
+		discard;
+	}
+
+	vec4 color = texture2D(colors, (cell + 0.5) / mapSize);
+	if (color.a < 0.5) {
+		discard;
+	}
+	gl_FragColor = vec4(color.rgb, 1.0);
+}
@@ -0,0 +1,8 @@
+//  Zoomed out map quad, passes the hex plane position on to the fragment shader
+varying vec2 world;
+
+void main()
+{
+	world = gl_Vertex.xy;
+	gl_Position = ftransform();
+}
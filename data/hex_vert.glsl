@@ -0,0 +1,42 @@
+#version 120
+#extension GL_ARB_draw_instanced : require
+
+//  Instanced hexes: the hex mesh is drawn once per cell of a run of
+//  consecutive cell indices, laid out in rows of rowWidth cells from origin.
+//  Colours and marks come from per-cell copies of the map's colour plane and
+//  HexRender's marks, the hex's hexEdge attribute gives edge distance.
+attribute float hexEdge;
+attribute vec3  hexColor;
+attribute float hexMarks;
+
+uniform vec2  spacing;
+uniform vec2  mapSize;
+//  first and last visible column
+uniform vec2  columns;
+uniform vec2  origin;
+uniform float rowWidth;
+
+varying float edge;
+varying float marks;
+
+void main()
+{
+	float cell = float(gl_InstanceIDARB);
+	float row = floor((cell + 0.5) / rowWidth);
+	vec2 hex = origin + vec2(cell - row * rowWidth, row);
+
+	//  chunks can overhang the map edge, their cells past it aren't drawn, 
+	//  nor are cells of a run outside the view
+	if (hex.x >= mapSize.x || hex.y >= mapSize.y || hex.x < columns.x || hex.x > columns.y) {
+		gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+		return;
+	}
+
+	//  HexGrid::HexToWorld, odd columns sit half a hex higher
+	vec2 world = vec2(hex.x, hex.y + 0.5 * mod(hex.x, 2.0)) * spacing;
+
+	edge = hexEdge;
+	marks = hexMarks;
+	gl_FrontColor = vec4(hexColor, 1.0);
+	gl_Position = gl_ModelViewProjectionMatrix * vec4(gl_Vertex.xy + world, gl_Vertex.z, 1.0);
+}
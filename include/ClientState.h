@@ -21,7 +21,7 @@ public:
 
     void enter();
     void leave();
-    void update();
+    void tick(float dt);
     void draw();
 
     virtual void keyDown(ci::app::KeyEvent event);
@@ -1,5 +1,6 @@
 #include "StateManager.h"
 #include "GuiController.h"
+#include "WarGame.h"
 
 namespace netphy
 {
@@ -12,6 +13,7 @@ public:
 
     void enter();
     void leave();
+    void tick(float dt);
     void update();
     void draw();
 
@@ -25,6 +27,9 @@ private:
     bool mDragStart;
     ci::Vec2f mDragOrigin;
     ci::Vec2f mDragEyeOrigin;
+
+    //  Territory shown by the 'c' key, kept to reuse its storage
+    std::vector<HexCoord> mConnected;
 };
 
 }
@@ -0,0 +1,58 @@
+#pragma once
+
+namespace netphy {
+
+/**
+  * Fixed rate simulation ticks under a variable rate of rendered frames
+  *
+  * Each frame adds the real time since the last to an accumulator and runs
+  * a tick for every whole tick period it holds, so the simulation advances
+  * at the tick rate however fast frames come.  A slow frame runs several
+  * ticks to catch up, up to a limit past which the simulation is let fall
+  * behind rather than spiral, and a fast one runs none.  Whatever is left
+  * over is how far the frame falls between the last tick and the next, for
+  * drawing interpolated state.
+  *
+  * The frame rate is only a target, the app applies it to its window.
+  *
+*/
+class FrameScheduler
+{
+public:
+    FrameScheduler(double tickRate=60.0, double frameRate=60.0);
+    ~FrameScheduler() { }
+
+    //  Ticks a second
+    void   setTickRate(double rate);
+    double getTickRate() const { return mTickRate; }
+    float  getTickSeconds() const { return float(1.0 / mTickRate); }
+
+    //  Frames a second the app should aim for
+    void   setFrameRate(double rate) { mFrameRate = rate; }
+    double getFrameRate() const { return mFrameRate; }
+
+    //  Most ticks one frame runs
+    void setMaxTicks(int ticks) { mMaxTicks = ticks; }
+    int  getMaxTicks() const { return mMaxTicks; }
+
+    //  Start a frame at a time in seconds, returns how many ticks it runs.
+    //  The first frame runs none.
+    int beginFrame(double now);
+
+    //  Where the frame falls from the last tick towards the next, 0 to 1
+    float getAlpha() const { return float(mAccumulator * mTickRate); }
+
+    //  Ticks run since the start
+    unsigned int getTickCount() const { return mTickCount; }
+
+private:
+    double       mTickRate;
+    double       mFrameRate;
+    int          mMaxTicks;
+    bool         mStarted;
+    double       mLastFrame;
+    double       mAccumulator;      //  seconds not yet ticked
+    unsigned int mTickCount;
+};
+
+}
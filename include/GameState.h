@@ -12,6 +12,7 @@ public:
 
     void enter();
     void leave();
+    void tick(float dt);
     void update();
     void draw();
 
@@ -16,6 +16,10 @@
 #include "cinder/Vector.h"
 #include "cinder/gl/Texture.h"
 
+#include "RenderBackend.h"
+#include "GuiText.h"
+#include "Log.h"
+
 namespace netphy
 {
 
@@ -48,6 +52,10 @@ typedef boost::shared_ptr<GuiCallback> GuiCallbackPtr;
 class GuiWidget;
 typedef boost::shared_ptr<GuiWidget> GuiWidgetPtr;
 
+//  Names a widget while it is attached to a controller, 0 names none.  A
+//  slot's generation is in the top bits, so a stale handle names nothing.
+typedef uint32_t GuiHandle;
+
 class GuiWidget 
 {
 protected:
@@ -55,18 +63,20 @@ protected:
 
     explicit GuiWidget();
     GuiController&          mGui;
-    GuiWidget*              mParent;
-    std::list<GuiWidgetPtr> mChildren;
-    ci::Vec2f               mPos;
-    ci::Vec2f               mSize;
+    GuiWidget*                mParent;
+    std::vector<GuiWidgetPtr> mChildren;
+    ci::Vec2f                 mPos;
+    ci::Vec2f                 mSize;
 
     virtual void drawImpl() { }
     virtual void updateImpl() { }
 
-    bool mPurge;
+private:
+    friend class GuiController;
+    GuiHandle mHandle;
 
 public:
-    GuiWidget(GuiController& gui, GuiWidget* parent=0) : mGui(gui), mParent(0), mPos(0,0), mPurge(false) { }
+    GuiWidget(GuiController& gui, GuiWidget* parent=0) : mGui(gui), mParent(0), mPos(0,0), mHandle(0) { }
     virtual ~GuiWidget() {}
 
     void draw();
@@ -78,13 +88,12 @@ public:
     ci::Vec2f getSize();
 
     void addChild(GuiWidgetPtr child);
-    GuiWidgetPtr getFirstChild() { return *(mChildren.begin()); }
+    GuiWidgetPtr getFirstChild() { return mChildren.front(); }
 
-    //  Detach from controller
-    void detach();
-    //  Purged widgets are safely detached from the controller at the end of update()
-    void purge(bool value=true) { mPurge = value; }
-    bool isPurged() { return mPurge; }
+    //  Detach from controller, safe while the controller is walking its widgets
+    void      detach();
+    bool      isAttached() const { return mHandle != 0; }
+    GuiHandle getHandle() const { return mHandle; }
 
 
     virtual bool keyDown(ci::app::KeyEvent event) { return false; }
@@ -116,6 +125,12 @@ struct GuiLabelData
           FgColor(1.0f, 1.0f, 1.0f, 1.0f), 
           BgColor(0, 0, 0, 1.0f)
     { }
+
+    //  Whether the text draws the same, Justify and BgColor aren't drawn
+    bool rendersAs(const GuiLabelData& other) const
+    {
+        return Text == other.Text && Font == other.Font && FontSize == other.FontSize && FgColor == other.FgColor;
+    }
 };
 
 class GuiLabelWidget;
@@ -129,14 +144,17 @@ protected:
 
     GuiLabelData mData;
 
-    ci::gl::Texture          mTexture;
-    std::vector<std::string> mText;
+    //  The size is kept until the data it was measured from changes
+    GuiLabelData             mRendered;
+    bool                     mDirty;
 
 public:
     GuiLabelWidget(GuiController& gui, const GuiLabelData& spec);
     ~GuiLabelWidget();
 
     GuiLabelData& getData() { return mData; }
+    //  Measure the text again on the next update even if unchanged
+    void invalidate() { mDirty = true; }
 };
 
 struct GuiQuadData
@@ -220,6 +238,50 @@ protected:
     std::string mInputBuffer;
 };
 
+/**
+  * The most recent lines written to a console, in fixed space
+  *
+  * Line text goes into a ring of bytes and each line's place in it into a
+  * ring of lines, so appending is constant time per byte and never
+  * allocates.  When either ring is full the oldest lines are dropped.  A
+  * line longer than the whole byte ring keeps only its end.  Positions in
+  * the byte ring count every byte ever written, so a line may wrap round
+  * its end.
+  *
+*/
+class ConsoleScrollback
+{
+public:
+    ConsoleScrollback(size_t lineCapacity=1000, size_t byteCapacity=64*1024);
+    ~ConsoleScrollback() { }
+
+    //  Append text to the last line, starting a new line at each newline
+    void append(const char* text, size_t length);
+    void clear();
+
+    size_t getLineCount() const { return mCount; }
+    //  Line text, 0 being the oldest line kept
+    void getLine(size_t index, std::string& text) const;
+
+private:
+    struct Line
+    {
+        uint64_t start;
+        size_t   length;
+    };
+
+    std::vector<char> mBytes;
+    std::vector<Line> mLines;
+    size_t            mFirst;       //  oldest line in mLines
+    size_t            mCount;
+    uint64_t          mTail;        //  first byte still in use
+    uint64_t          mHead;        //  next byte to write
+
+    void newLine();
+    void appendToLine(const char* text, size_t length);
+    void dropOldest();
+};
+
 class GuiConsole;
 class GuiConsoleStream
 {
@@ -237,16 +299,32 @@ private:
 };
 typedef boost::iostreams::stream<GuiConsoleStream> GuiConsoleOutput;
 
-class GuiConsole : public GuiWidget
+//  Text written to the console goes through its log sink, so any thread
+//  may write and the console takes it in when the log is next drained
+class GuiConsole : public GuiWidget, public LogTarget
 {
 public:
     GuiConsole(GuiController& gui, int lineCount, float fontSize);
     boost::iostreams::stream<GuiConsoleStream> output();
+    LogSink& log() { return mLog; }
 
+    //  Queue text for the console through its log, from any thread
     void appendString(const std::string& text);
-    //  clears buffer
+    void append(const char* text, size_t length);
+    //  Take in the text logged since the last drain, once a frame whether
+    //  the console is shown or not
+    void drainLog() { mLog.drain(*this); }
+    //  LogTarget implementation, where the sink is drained to
+    virtual void write(LogLevel level, const char* text, size_t length) { mScrollback.append(text, length); }
+    //  clears buffer, along with anything logged but not yet drained
     void clear();
 
+    //  Lines kept and bytes of text they may take, clearing the console
+    void setScrollbackCapacity(size_t lines, size_t bytes);
+    //  Lines scrolled back from the newest, held within the scrollback
+    void setScroll(int lines);
+    int  getScroll() const { return mScroll; }
+
     //  Set console widget width. Height is based on font height * number of lines
     void setWidth(float width);
     virtual bool keyDown(ci::app::KeyEvent event);
@@ -255,10 +333,10 @@ public:
 
 protected:
     int mLineCount;
-    std::list<std::string> mBuffer;
+    LogSink mLog;
+    ConsoleScrollback mScrollback;
     std::list<GuiLabelWidgetPtr> mLines;
-    //  The point in the buffer where the display starts
-    std::list<std::string>::iterator mConsoleStart;
+    int mScroll;
 
     ConsoleInputBuffer mConsoleBuffer;
     // std::string mInput;
@@ -306,9 +384,13 @@ public:
 
     std::vector<GuiWidgetPtr>& widgets();
 
-    void attach(GuiWidgetPtr widget);
-    void detach(GuiWidget* ptr);
-    void detachAll();
+    //  Widgets draw in the order attached, attaching one again brings it to the top
+    GuiHandle  attach(GuiWidgetPtr widget);
+    void       detach(GuiWidget* widget);
+    void       detach(GuiHandle handle);
+    void       detachAll();
+    //  The attached widget a handle names, 0 if there is none
+    GuiWidget* get(GuiHandle handle) const;
 
     bool keyDown(ci::app::KeyEvent event);
     void mouseMove(ci::app::MouseEvent event);
@@ -319,10 +401,41 @@ public:
 
     void setShared(boost::shared_ptr<Shared> shared) { mShared = shared; }
 
+    //  Widgets draw through the backend, GL unless replaced
+    RenderBackend& getBackend() { return *mBackend; }
+    void setBackend(RenderBackendPtr backend) { mBackend = backend; }
+
+    //  Text of every label, drawn after the widgets
+    GuiText& getText() { return mText; }
+
+    //  Where the widget being drawn sits in the window
+    const ci::Vec2f& getOrigin() const { return mOrigin; }
+    void translate(const ci::Vec2f& offset) { mOrigin += offset; }
+
 protected:
     boost::shared_ptr<Shared> mShared;
-    std::list<GuiWidgetPtr> mWidgets;
+    RenderBackendPtr mBackend;
+    GuiText          mText;
+    ci::Vec2f        mOrigin;
     boost::shared_ptr<GuiRenderer> mRenderer;
+
+    //  Attached widgets are owned by slots that handles index.  They are
+    //  walked through mAttached, where detaching leaves a hole that the next
+    //  update closes, and released on the next update too, so a widget can
+    //  detach itself or others from inside its own handlers.
+    struct Slot
+    {
+        GuiWidgetPtr widget;
+        uint32_t     generation;
+        uint32_t     order;         //  index in mAttached
+    };
+    std::vector<Slot>         mSlots;
+    std::vector<uint32_t>     mFree;
+    std::vector<GuiWidget*>   mAttached;
+    size_t                    mHoles;
+    std::vector<GuiWidgetPtr> mReleased;
+
+    void compact();
 };
 
 }
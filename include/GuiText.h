@@ -0,0 +1,124 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cinder/Color.h"
+#include "cinder/Font.h"
+#include "cinder/Surface.h"
+#include "cinder/Vector.h"
+#include "cinder/gl/Texture.h"
+#include "cinder/gl/Vbo.h"
+
+#include "RenderBackend.h"
+
+namespace netphy {
+
+/**
+  * Glyphs of every font the gui uses, packed into one texture
+  *
+  * A glyph is rasterised the first time its font, size and character are
+  * asked for, white so text can be tinted any colour, and placed on a
+  * shelf of the atlas.  Only the areas of new glyphs are uploaded.  When a
+  * glyph no longer fits, it and any new glyph after it are left blank and
+  * the atlas starts over on the next frame, so filling the atlas costs a
+  * frame of missing text.  Advances are kept, so text measures the same.
+  *
+*/
+class GuiGlyphAtlas
+{
+public:
+    struct Glyph
+    {
+        bool     measured;
+        bool     placed;
+        ci::Area area;          //  in the atlas, empty for a blank glyph
+        float    advance;       //  from this glyph to the next along the line
+
+        Glyph() : measured(false), placed(false), area(0, 0, 0, 0), advance(0) { }
+    };
+
+    struct Face
+    {
+        ci::Font font;
+        float    lineHeight;
+        float    pipes;         //  width of "||", to find advances with
+        Glyph    glyphs[256];
+    };
+
+    GuiGlyphAtlas(int size=1024);
+    ~GuiGlyphAtlas() { }
+
+    Face&        face(const std::string& font, float size);
+    const Glyph& glyph(Face& face, char ch);
+
+    //  Start over if a glyph no longer fit, before any glyph of the frame is placed
+    void beginFrame();
+    //  Upload the glyphs placed since the last sync
+    void sync(RenderBackend& backend);
+
+    ci::gl::Texture& getTexture() { return mTexture; }
+    ci::Vec2f        getSize() const { return ci::Vec2f(float(mSize), float(mSize)); }
+
+private:
+    typedef std::map<std::pair<std::string, float>, Face> FaceMap;
+
+    int             mSize;
+    FaceMap         mFaces;
+    ci::Surface     mPixels;
+    ci::gl::Texture mTexture;
+    bool            mCreated;
+
+    //  Shelf packing, the shelf being filled starts at mCursor.y
+    ci::Vec2i       mCursor;
+    int             mShelfHeight;
+    bool            mFull;
+    ci::Area        mDirty;
+
+    void clear();
+    void place(const ci::Surface& image, ci::Area& area);
+};
+
+/**
+  * The gui's text, batched into a single draw
+  *
+  * Labels add their text as quads over glyphs of the atlas while the gui
+  * draws, and draw() sends all of it at once from one vertex buffer, after
+  * every widget.  Text is therefore always above the gui's quads.  A frame
+  * whose text is the same as the last uploads nothing.
+  *
+*/
+class GuiText
+{
+public:
+    GuiText();
+    ~GuiText() { }
+
+    //  Size of text laid out in a font, a line for each newline
+    ci::Vec2f measure(const std::string& text, const std::string& font, float size);
+
+    //  Start a frame's text
+    void begin();
+    //  Text with its top left at pos, in window coordinates
+    void add(const std::string& text, const std::string& font, float size, const ci::ColorA& color, const ci::Vec2f& pos);
+    //  Draw the frame's text
+    void draw(RenderBackend& backend);
+
+private:
+    struct TextVertex
+    {
+        ci::Vec2f    position;
+        ci::Vec2f    texCoord;
+        ci::ColorA8u color;
+    };
+
+    GuiGlyphAtlas           mAtlas;
+    std::vector<TextVertex> mVertices;
+    std::vector<TextVertex> mUploaded;      //  what mVertexVbo holds
+    size_t                  mQuadCapacity;
+    ci::gl::Vbo             mVertexVbo;
+    ci::gl::Vbo             mIndexVbo;
+};
+
+}
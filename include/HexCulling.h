@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+#include "WarGame.h"
+
+namespace netphy {
+
+//  Inclusive span of rows in one column of hexes, empty when first > last
+struct HexSpan
+{
+    int first;
+    int last;
+
+    HexSpan() : first(0), last(-1) { }
+    HexSpan(int first, int last) : first(first), last(last) { }
+    bool isEmpty() const { return last < first; }
+    int  size() const { return isEmpty() ? 0 : last - first + 1; }
+};
+
+/**
+  * The cells of a hex map in view of a camera
+  *
+  * The rays through the four corners of the view are intersected with the 
+  * hex plane, z = 0, giving the quad of the plane the camera sees.  Each 
+  * column of hexes the quad reaches gets the span of rows whose hexes fall 
+  * within the quad across that column, clamped to the map, so tilted and 
+  * rotated views cull as tightly as a straight down one.  A corner ray that 
+  * misses the plane, at or above the horizon, is cut off at the far clip.
+  *
+*/
+class HexCuller
+{
+public:
+    HexCuller();
+    ~HexCuller() { }
+
+    void update(const ci::Camera& camera, const HexGrid& grid, const ci::Vec2i& mapSize);
+
+    bool isEmpty() const { return mVisibleCount == 0; }
+    bool isVisible(const HexCoord& pos) const;
+    //  Whether any cell of an inclusive rectangle of cells is visible
+    bool intersects(const HexCoord& min, const HexCoord& max) const;
+
+    //  Visible rows of a column, empty outside the visible columns
+    HexSpan span(int column) const;
+    int firstColumn() const { return mFirstColumn; }
+    int lastColumn() const { return mFirstColumn + int(mSpans.size()) - 1; }
+
+    //  Inclusive bounds of the visible cells, min > max when none are
+    const HexCoord& getMin() const { return mMin; }
+    const HexCoord& getMax() const { return mMax; }
+
+    //  Instrumentation: visible cells, and the corners of the quad in view
+    int getVisibleCount() const { return mVisibleCount; }
+    const ci::Vec2f* getQuad() const { return mQuad; }
+
+private:
+    ci::Vec2f            mQuad[4];
+    int                  mFirstColumn;
+    std::vector<HexSpan> mSpans;
+    HexCoord             mMin;
+    HexCoord             mMax;
+    int                  mVisibleCount;
+
+    bool quadRange(float left, float right, float& bottom, float& top) const;
+};
+
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+#include "WarGame.h"
+
+namespace netphy {
+
+//  Inclusive bounding box of a region in hex coordinates
+struct HexBounds
+{
+    HexCoord min;
+    HexCoord max;
+
+    HexBounds() : min(0, 0), max(-1, -1) { }
+    bool isEmpty() const { return max.x < min.x; }
+};
+
+//  Connected component labels for the land cells of a HexMap.  Cells are in
+//  the same region when they are adjacent land cells with the same owner.
+struct HexLabels
+{
+    //  Per cell region label, -1 for sea.  A full labelling numbers regions in 
+    //  cell index order of their first cell, incremental updates reuse the 
+    //  labels of removed regions.
+    std::vector<int>       labels;
+    //  Per region cell count and bounding box, labels with size 0 are unused
+    std::vector<int>       sizes;
+    std::vector<HexBounds> bounds;
+
+    int regionCount() const { return int(sizes.size()); }
+};
+
+/**
+  * Labels HexMap regions in a single pass using union-find
+  *
+  * Each land cell is unioned with its already scanned neighbours, roots always 
+  * being the lowest cell index in a set, then a second pass flattens the sets 
+  * into dense labels.  Scratch arrays are kept between calls.
+  *
+  * With more than one thread, large maps are split into tiles of whole rows 
+  * (or whole chunks) that are unioned and labelled on worker threads.  Unions 
+  * across tile seams are deferred and done on the calling thread in between.
+  * Roots are still the lowest index in each set, so labels are the same as a 
+  * single threaded pass.
+  *
+*/
+class HexLabeller
+{
+public:
+    //  threads 0 uses every hardware thread
+    HexLabeller(int threads=1);
+    ~HexLabeller() { }
+
+    void label(const HexMap& map, HexLabels& result);
+
+    void setThreads(int threads) { mThreads = threads; }
+    int  getThreads() const { return mThreads; }
+
+private:
+    //  Region stats a tile gathered for regions rooted in earlier tiles
+    struct ForeignRegion
+    {
+        int       label;
+        int       size;
+        HexBounds bounds;
+    };
+
+    //  A contiguous range of cell indices labelled by one worker
+    struct Tile
+    {
+        int begin;
+        int end;
+        int firstRow;   //  row range on maps that are not chunked
+        int lastRow;
+        int roots;
+        int base;       //  label of the tile's first root
+
+        std::vector<std::pair<int, int> > seams;     //  unions with earlier tiles
+        std::vector<ForeignRegion>        foreign;
+        std::map<int, int>                foreignSlots;
+    };
+
+    int               mThreads;
+    std::vector<int>  mParent;
+    std::vector<int>  mRoots;
+    std::vector<Tile> mTiles;
+
+    typedef void (HexLabeller::*TileStage)(const HexMap&, Tile&, HexLabels&);
+
+    void labelTiled(const HexMap& map, HexLabels& result, int threads);
+    void runTiles(TileStage stage, const HexMap& map, HexLabels& result);
+    void uniteTile(const HexMap& map, Tile& tile, HexLabels& result);
+    void findRoots(const HexMap& map, Tile& tile, HexLabels& result);
+    void labelRoots(const HexMap& map, Tile& tile, HexLabels& result);
+    void labelCells(const HexMap& map, Tile& tile, HexLabels& result);
+
+    int  find(int cell);
+    int  findRoot(int cell) const;
+    void unite(int a, int b);
+};
+typedef boost::shared_ptr<HexLabeller> HexLabellerPtr;
+
+/**
+  * Keeps a HexMap's region labels up to date as single cells change
+  *
+  * A cell joining a region takes the label of its largest same-owner 
+  * neighbour, relabelling any other neighbouring regions it connects.  A cell 
+  * leaving a region re-floods only that region to find out whether it split.
+  * Either way the work is bounded by the regions touching the cell.
+  *
+*/
+class HexRegionTracker
+{
+public:
+    HexRegionTracker(const HexMap& map);
+    ~HexRegionTracker() { }
+
+    //  Relabel the whole map, for initial setup and after bulk edits
+    void reset();
+    //  Update labels after a cell's land or owner changed
+    void cellChanged(int cell);
+    //  Grow the labels after a chunked map gives chunks storage
+    void cellsAdded();
+
+    const HexLabels& labels() const { return mLabels; }
+    //  Labeller used for full relabels
+    HexLabeller& labeller() { return mLabeller; }
+
+    void subscribe(HexRegionCallbackPtr callback);
+    void unsubscribe(HexRegionCallbackPtr callback);
+
+private:
+    const HexMap& mMap;
+    HexLabeller   mLabeller;
+    HexLabels     mLabels;
+    std::vector<int> mFreeLabels;
+    std::vector<HexRegionCallbackPtr> mCallbacks;
+
+    //  Flood fill scratch
+    std::vector<uint32_t> mVisited;
+    uint32_t              mVisitEpoch;
+    std::vector<int>      mStack;
+
+    void addCell(int cell);
+    void removeCell(int cell, int label);
+
+    int  newLabel();
+    void freeLabel(int label);
+    int  flood(int start, int from, int to, HexBounds& bounds, uint32_t epoch);
+    uint32_t beginVisit();
+
+    void notify(HexRegionEvent::Type type, int label, int other=-1);
+};
+typedef boost::shared_ptr<HexRegionTracker> HexRegionTrackerPtr;
+
+}
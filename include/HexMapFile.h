@@ -0,0 +1,80 @@
+#pragma once
+
+#include <string>
+
+#include "cinder/Cinder.h"
+
+namespace netphy {
+
+/**
+  * Binary HexMap file layout, version 1
+  *
+  * A fixed size header followed by sections at the byte offsets it gives,
+  * each aligned to HEXMAP_FILE_ALIGN.  The sections are the map's storage
+  * planes exactly as HexMap holds them, so loading maps them in place:
+  *
+  *     chunks  int32 per resident chunk in slot order, chunked maps only
+  *     land    uint32 words of packed land bits, cellCount/32 rounded up
+  *     owners  uint8 per cell
+  *     colors  3 byte rgb per cell, optional
+  *
+  * cellCount is the map's index space, width * height for plain maps.
+  * Maps are at most HEXMAP_FILE_MAX_SIDE cells on a side, so every cell
+  * index and section size fits an int.  Everything is stored little-endian.
+  *
+*/
+enum {
+    HEXMAP_FILE_VERSION  = 1,
+    HEXMAP_FILE_ALIGN    = 64,
+    HEXMAP_FILE_MAX_SIDE = 16384
+};
+
+enum HexMapFileFlags {
+    HEXMAP_FILE_CHUNKED = 1 << 0,
+    HEXMAP_FILE_COLORS  = 1 << 1
+};
+
+struct HexMapFileHeader
+{
+    char     magic[4];      //  "NPHX"
+    uint32_t version;
+    int32_t  width;
+    int32_t  height;
+    uint32_t flags;
+    uint32_t cellCount;
+    uint32_t chunkCount;
+    uint32_t chunksOffset;
+    uint32_t landOffset;
+    uint32_t ownersOffset;
+    uint32_t colorsOffset;
+    uint32_t reserved[5];
+};
+
+//  Read-only file mapped copy-on-write, writes to the mapped pages stay private
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string& path);
+    void close();
+
+    uint8_t* data() { return mData; }
+    size_t   size() const { return mSize; }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+#if defined(_WIN32)
+    void*    mFile;
+    void*    mMapping;
+#else
+    int      mFile;
+#endif
+    uint8_t* mData;
+    size_t   mSize;
+};
+
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+
+#include "WarGame.h"
+
+namespace netphy {
+
+//  Cost of moving onto a cell, by whether it is land and who owns it
+class HexPathCosts
+{
+public:
+    enum { IMPASSABLE = -1 };
+
+    HexPathCosts(int land=1, int sea=IMPASSABLE);
+
+    void setSea(int cost) { mSea = cost; }
+    //  Same cost for land of every owner
+    void setLand(int cost);
+    void setOwner(int owner, int cost) 
+    { 
+        assert(owner >= 0 && owner < 256);
+        mLand[owner] = cost; 
+    }
+
+    int cost(bool land, int owner) const { return land ? mLand[owner] : mSea; }
+    int cost(const HexMap& map, int index) const { return cost(map.isLand(index), map.getOwner(index)); }
+
+    //  Cheapest passable cost, scales the distance heuristic
+    int minimum() const;
+
+private:
+    int mSea;
+    int mLand[256];
+};
+
+/**
+  * A* search between two cells of a HexMap
+  *
+  * Steps cost whatever the cell moved onto costs, the heuristic is the hex
+  * distance times the cheapest cost so paths are always shortest.  Search
+  * state is kept per cell and stamped per query, so once the arrays are
+  * sized to the map a query does not allocate.
+  *
+  * On a chunked map, cells without storage are impassable.
+  *
+*/
+class HexPathfinder
+{
+public:
+    HexPathfinder(const HexMap& map);
+    ~HexPathfinder() { }
+
+    //  Fill path with the steps from one cell to another, not including from.
+    //  Returns false if to can't be reached.
+    bool findPath(const HexCoord& from, const HexCoord& to, const HexPathCosts& costs, std::vector<HexCoord>& path);
+
+    //  Total cost of the last path found
+    int getCost() const { return mCost; }
+
+private:
+    //  Open list entry, ordered by estimated total cost
+    struct Node
+    {
+        int f;
+        int g;
+        int cell;
+
+        bool operator<(const Node& other) const { return f > other.f; }
+    };
+
+    const HexMap& mMap;
+    int           mCost;
+
+    std::vector<int>      mG;       //  cheapest known cost to each cell
+    std::vector<int>      mParent;  //  cell it was reached from, -1 for the start
+    std::vector<uint32_t> mStamp;   //  query that last touched each cell
+    uint32_t              mEpoch;
+    std::vector<Node>     mOpen;
+
+    uint32_t beginSearch();
+};
+
+/**
+  * Cheapest direction towards a set of targets from every reachable cell
+  *
+  * Built with one multi-source Dijkstra pass from the targets, after which
+  * any number of units can look up their next step in constant time.  Build
+  * one per goal each turn and share it between every unit heading there.
+  * Rebuilding reuses the arrays.
+  *
+*/
+class HexFlowField
+{
+public:
+    HexFlowField(const HexMap& map);
+    ~HexFlowField() { }
+
+    void build(const std::vector<HexCoord>& targets, const HexPathCosts& costs);
+
+    //  Cost to the nearest target, -1 if no target can be reached
+    int distance(const HexCoord& pos) const;
+    //  Direction of the next step, -1 at a target or where none is reachable
+    int direction(const HexCoord& pos) const;
+    //  Next cell to move to, pos itself if there is none
+    HexCoord next(const HexCoord& pos) const;
+
+private:
+    struct Node
+    {
+        int d;
+        int cell;
+
+        bool operator<(const Node& other) const { return d > other.d; }
+    };
+
+    const HexMap& mMap;
+
+    std::vector<int>    mDistance;
+    std::vector<int8_t> mDirection;
+    std::vector<Node>   mOpen;
+
+    bool reached(int index) const { return index >= 0 && size_t(index) < mDistance.size() && mDistance[index] >= 0; }
+};
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+
+#include "WarGame.h"
+
+namespace netphy {
+
+/**
+  * Which hexes lie under points of the screen
+  *
+  * The hex under the mouse is found once a frame, by update(), and every
+  * state reads it from here rather than casting its own ray.  Screen points
+  * are in Mouse::getPos coordinates, 0 to 1 from the bottom left.
+  *
+  * A rectangle or lasso of screen points picks the cells whose centres it
+  * covers on the map.  Its points are cast onto the hex plane, where the
+  * straight edges between them stay straight, and each column of hexes
+  * takes the rows between where the resulting polygon's edges cross it, so
+  * the cost grows with the columns and edges rather than the cells.  A ray
+  * that misses the plane is cut off at the far clip, as in HexCuller.
+  *
+*/
+class HexPicker
+{
+public:
+    HexPicker(HexRender& render, HexGrid& grid, Mouse& mouse);
+    ~HexPicker() { }
+
+    //  Cast the mouse ray for this frame, before the states update
+    void update();
+
+    //  Hex under the mouse, which may be off the map, and where the ray meets the plane
+    const HexCoord&  getHoveredHex() const { return mHoveredHex; }
+    const ci::Vec3f& getHoveredPoint() const { return mHoveredPoint; }
+
+    //  Point of the hex plane under a screen point
+    ci::Vec3f project(const ci::Vec2f& screen) const;
+
+    //  Cells of a map covered by a rectangle between two screen corners, or
+    //  by a closed lasso of screen points, column by column
+    void pickRect(const HexMap& map, const ci::Vec2f& corner, const ci::Vec2f& opposite, std::vector<HexCoord>& cells);
+    void pickLasso(const HexMap& map, const std::vector<ci::Vec2f>& points, std::vector<HexCoord>& cells);
+
+private:
+    HexRender& mRender;
+    HexGrid&   mHexGrid;
+    Mouse&     mMouse;
+
+    HexCoord   mHoveredHex;
+    ci::Vec3f  mHoveredPoint;
+
+    //  Scratch for picking
+    std::vector<ci::Vec2f> mScreen;
+    std::vector<ci::Vec2f> mPolygon;
+    std::vector<float>     mCrossings;
+
+    void pickPolygon(const HexMap& map, std::vector<HexCoord>& cells);
+};
+typedef boost::shared_ptr<HexPicker> HexPickerPtr;
+
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace netphy {
+
+enum LogLevel
+{
+    LEVEL_DEBUG,
+    LEVEL_INFO,
+    LEVEL_WARNING,
+    LEVEL_ERROR
+};
+
+//  Where a LogSink's messages go when it is drained
+struct LogTarget
+{
+    virtual void write(LogLevel level, const char* text, size_t length) = 0;
+};
+
+/**
+  * Log messages from any thread, read on one
+  *
+  * Messages go into a fixed ring of slots, each with a sequence number
+  * saying whether it is free, being written or ready.  A writer claims a
+  * slot with one compare and swap on the enqueue position and publishes it
+  * by storing the slot's sequence, so writers never wait on each other or
+  * on the reader.  If the ring is full the message is dropped and counted
+  * instead.  The reader drains every ready slot in order, once a frame,
+  * and reports how many were dropped.
+  *
+  * Messages longer than a slot are cut short.  Levels below the sink's are
+  * dropped before any formatting when written through NETPHY_LOG.
+  *
+*/
+class LogSink
+{
+public:
+    //  capacity is rounded up to a power of two
+    LogSink(size_t capacity=1024);
+    ~LogSink() { }
+
+    void     setLevel(LogLevel level) { mLevel = level; }
+    LogLevel getLevel() const { return LogLevel(mLevel); }
+    bool     isEnabled(LogLevel level) const { return level >= mLevel; }
+
+    //  Queue text as it is, false if it was dropped.  Any thread.
+    bool write(LogLevel level, const char* text, size_t length);
+
+    //  Hand every queued message to a target, returns how many.  One thread.
+    size_t drain(LogTarget& target);
+
+    //  Text a slot holds
+    enum { SlotText = 240 };
+
+private:
+    struct Slot
+    {
+        volatile long sequence;
+        LogLevel      level;
+        size_t        length;
+        char          text[SlotText];
+    };
+
+    std::vector<Slot> mSlots;
+    unsigned long     mMask;
+    volatile long     mEnqueue;
+    unsigned long     mDequeue;         //  reader's alone
+    volatile long     mDropped;
+    volatile int      mLevel;
+
+    explicit LogSink(const LogSink&);
+    LogSink& operator=(const LogSink&);
+};
+
+/**
+  * A line of a log, formatted on the writing thread's stack
+  *
+  * Values are printed into a buffer of the line's own as they are given,
+  * with no iostreams or allocation, and the line goes to the sink in one
+  * write when the LogLine is destroyed.  Use it through NETPHY_LOG, which
+  * skips building the line at all when its level is disabled:
+  *
+  *     NETPHY_LOG(GG.console->log(), LEVEL_INFO) << "Loaded " << path;
+  *
+*/
+class LogLine
+{
+public:
+    LogLine(LogSink& sink, LogLevel level) : mSink(sink), mLevel(level), mLength(0) { }
+    ~LogLine();
+
+    LogLine& operator<<(const char* text);
+    LogLine& operator<<(const std::string& text);
+    LogLine& operator<<(char value);
+    LogLine& operator<<(int value);
+    LogLine& operator<<(unsigned int value);
+    LogLine& operator<<(long value);
+    LogLine& operator<<(unsigned long value);
+    LogLine& operator<<(double value);
+
+private:
+    LogSink& mSink;
+    LogLevel mLevel;
+    size_t   mLength;
+    char     mText[LogSink::SlotText];
+
+    void append(const char* text, size_t length);
+    void print(const char* format, ...);
+
+    explicit LogLine(const LogLine&);
+    LogLine& operator=(const LogLine&);
+};
+
+}
+
+//  Log a line to a sink if its level is enabled, the rest of the statement
+//  isn't evaluated otherwise
+#define NETPHY_LOG(sink, level) \
+    if (!(sink).isEnabled(level)) ; else netphy::LogLine((sink), (level))
@@ -20,11 +20,14 @@ public:
 
     void setup();
     void update(float dt);
-    void draw();
+    //  Report the body alpha of the way from its previous step to its last
+    void draw(float alpha);
 
 private:
     shared_ptr<b2World> mWorld;
     b2Body* mBody;
+    b2Vec2  mPrevPosition;
+    float32 mPrevAngle;
     Shared& GG;
 };
 
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <vector>
+#include <boost/smart_ptr.hpp>
+
+#include "cinder/Camera.h"
+#include "cinder/Color.h"
+#include "cinder/Matrix.h"
+#include "cinder/Rect.h"
+#include "cinder/Vector.h"
+#include "cinder/gl/gl.h"
+#include "cinder/gl/GlslProg.h"
+#include "cinder/gl/Texture.h"
+#include "cinder/gl/Vbo.h"
+
+namespace netphy {
+
+/**
+  * Render commands under HexRender and the gui
+  *
+  * Draw paths issue their uploads, state changes and draws through a
+  * backend rather than calling GL.  GlRenderBackend does what they used
+  * to, RecordingRenderBackend only counts them and needs no GL context, so
+  * render-side CPU cost can be measured on machines without a GPU.
+  *
+  * Buffers, textures and shaders are still Cinder objects owned by the
+  * caller.  Backends without a context never create them, callers check
+  * hasContext() before loading anything.
+  *
+*/
+class RenderBackend
+{
+public:
+    //  Fixed function arrays for vertexArray, shader attributes are >= 0
+    enum {
+        POSITION_ARRAY = -1,
+        COLOR_ARRAY    = -2,
+        TEXCOORD_ARRAY = -3
+    };
+
+    virtual ~RenderBackend() { }
+
+    //  Capabilities
+    virtual bool  hasContext() const = 0;
+    virtual bool  hasInstancing() = 0;
+    virtual GLint getMaxTextureSize() = 0;
+    virtual GLint attribLocation(ci::gl::GlslProg& shader, const char* name) = 0;
+
+    //  Uploads, creating the buffer or texture as needed.  rowLength is the
+    //  distance between rows of the source in pixels.
+    virtual void bufferData(ci::gl::Vbo& vbo, GLenum target, size_t bytes, const void* data, GLenum usage) = 0;
+    virtual void bufferSubData(ci::gl::Vbo& vbo, size_t offset, size_t bytes, const void* data) = 0;
+    virtual void createTexture(ci::gl::Texture& texture, int width, int height, const ci::gl::Texture::Format& format) = 0;
+    virtual void createTexture(ci::gl::Texture& texture, const ci::Surface& surface) = 0;
+    virtual void textureSubImage(ci::gl::Texture& texture, const ci::Area& area, int rowLength, GLenum format, const void* data) = 0;
+
+    //  State
+    void setMatrices(const ci::Camera& camera) { setMatrices(camera.getProjectionMatrix(), camera.getModelViewMatrix()); }
+    virtual void setMatrices(const ci::Matrix44f& projection, const ci::Matrix44f& modelView) = 0;
+    virtual void pushMatrix(const ci::Vec2f& translate) = 0;
+    virtual void popMatrix() = 0;
+    virtual void color(const ci::ColorA& color) = 0;
+    virtual void clear(const ci::ColorA& color) = 0;
+    virtual void bindShader(ci::gl::GlslProg& shader) = 0;
+    virtual void unbindShader(ci::gl::GlslProg& shader) = 0;
+    virtual void uniform(ci::gl::GlslProg& shader, const char* name, int value) = 0;
+    virtual void uniform(ci::gl::GlslProg& shader, const char* name, float value) = 0;
+    virtual void uniform(ci::gl::GlslProg& shader, const char* name, const ci::Vec2f& value) = 0;
+    virtual void uniform(ci::gl::GlslProg& shader, const char* name, const ci::ColorA& value) = 0;
+    virtual void bindTexture(ci::gl::Texture& texture) = 0;
+    virtual void unbindTexture(ci::gl::Texture& texture) = 0;
+
+    //  Source a vertex array from a buffer, advancing once per instance
+    //  rather than per vertex when divisor is 1
+    virtual void vertexArray(ci::gl::Vbo& vbo, GLint array, GLint components, GLenum type, bool normalize,
+                             GLsizei stride, size_t offset, GLuint divisor=0) = 0;
+    //  Disable every array enabled since the last call
+    virtual void disableArrays() = 0;
+
+    //  Draws, instances 0 is an ordinary draw
+    virtual void drawElements(ci::gl::Vbo& indices, GLenum mode, GLsizei count, GLenum type, GLsizei instances=0) = 0;
+    virtual void drawRect(const ci::Rectf& rect) = 0;
+    virtual void drawTexture(ci::gl::Texture& texture, const ci::Vec2f& pos) = 0;
+};
+typedef boost::shared_ptr<RenderBackend> RenderBackendPtr;
+
+//  Backend drawing with the current GL context
+class GlRenderBackend : public RenderBackend
+{
+public:
+    GlRenderBackend();
+    ~GlRenderBackend() { }
+
+    bool  hasContext() const { return true; }
+    bool  hasInstancing();
+    GLint getMaxTextureSize();
+    GLint attribLocation(ci::gl::GlslProg& shader, const char* name);
+
+    void bufferData(ci::gl::Vbo& vbo, GLenum target, size_t bytes, const void* data, GLenum usage);
+    void bufferSubData(ci::gl::Vbo& vbo, size_t offset, size_t bytes, const void* data);
+    void createTexture(ci::gl::Texture& texture, int width, int height, const ci::gl::Texture::Format& format);
+    void createTexture(ci::gl::Texture& texture, const ci::Surface& surface);
+    void textureSubImage(ci::gl::Texture& texture, const ci::Area& area, int rowLength, GLenum format, const void* data);
+
+    using RenderBackend::setMatrices;
+    void setMatrices(const ci::Matrix44f& projection, const ci::Matrix44f& modelView);
+    void pushMatrix(const ci::Vec2f& translate);
+    void popMatrix();
+    void color(const ci::ColorA& color);
+    void clear(const ci::ColorA& color);
+    void bindShader(ci::gl::GlslProg& shader);
+    void unbindShader(ci::gl::GlslProg& shader);
+    void uniform(ci::gl::GlslProg& shader, const char* name, int value);
+    void uniform(ci::gl::GlslProg& shader, const char* name, float value);
+    void uniform(ci::gl::GlslProg& shader, const char* name, const ci::Vec2f& value);
+    void uniform(ci::gl::GlslProg& shader, const char* name, const ci::ColorA& value);
+    void bindTexture(ci::gl::Texture& texture);
+    void unbindTexture(ci::gl::Texture& texture);
+
+    void vertexArray(ci::gl::Vbo& vbo, GLint array, GLint components, GLenum type, bool normalize,
+                     GLsizei stride, size_t offset, GLuint divisor=0);
+    void disableArrays();
+
+    void drawElements(ci::gl::Vbo& indices, GLenum mode, GLsizei count, GLenum type, GLsizei instances=0);
+    void drawRect(const ci::Rectf& rect);
+    void drawTexture(ci::gl::Texture& texture, const ci::Vec2f& pos);
+
+private:
+    //  Capabilities are queried once, -1 until then
+    int   mInstancing;
+    GLint mMaxTextureSize;
+
+    //  Arrays enabled since the last disableArrays, and whether any had a divisor
+    std::vector<GLint> mEnabled;
+    bool               mDivisors;
+};
+
+//  What a RecordingRenderBackend has seen since its stats were last reset
+struct RenderStats
+{
+    int    drawCalls;
+    int    stateChanges;
+    size_t vertices;        //  submitted, counting every instance
+    size_t bytesUploaded;
+
+    RenderStats() : drawCalls(0), stateChanges(0), vertices(0), bytesUploaded(0) { }
+};
+
+//  Backend counting commands without drawing, it needs no GL context.  The
+//  capabilities it reports choose which HexRender paths run.
+class RecordingRenderBackend : public RenderBackend
+{
+public:
+    RecordingRenderBackend(bool instancing=true, GLint maxTextureSize=8192);
+    ~RecordingRenderBackend() { }
+
+    const RenderStats& getStats() const { return mStats; }
+    void resetStats() { mStats = RenderStats(); }
+
+    bool  hasContext() const { return false; }
+    bool  hasInstancing() { return mInstancing; }
+    GLint getMaxTextureSize() { return mMaxTextureSize; }
+    GLint attribLocation(ci::gl::GlslProg&, const char*) { return 0; }
+
+    void bufferData(ci::gl::Vbo&, GLenum, size_t bytes, const void*, GLenum) { upload(bytes); }
+    void bufferSubData(ci::gl::Vbo&, size_t, size_t bytes, const void*) { upload(bytes); }
+    void createTexture(ci::gl::Texture&, int, int, const ci::gl::Texture::Format&) { upload(0); }
+    void createTexture(ci::gl::Texture&, const ci::Surface& surface);
+    void textureSubImage(ci::gl::Texture&, const ci::Area& area, int, GLenum format, const void*);
+
+    using RenderBackend::setMatrices;
+    void setMatrices(const ci::Matrix44f&, const ci::Matrix44f&) { ++mStats.stateChanges; }
+    void pushMatrix(const ci::Vec2f&) { ++mStats.stateChanges; }
+    void popMatrix() { ++mStats.stateChanges; }
+    void color(const ci::ColorA&) { ++mStats.stateChanges; }
+    void clear(const ci::ColorA&) { ++mStats.stateChanges; }
+    void bindShader(ci::gl::GlslProg&) { ++mStats.stateChanges; }
+    void unbindShader(ci::gl::GlslProg&) { ++mStats.stateChanges; }
+    void uniform(ci::gl::GlslProg&, const char*, int) { ++mStats.stateChanges; }
+    void uniform(ci::gl::GlslProg&, const char*, float) { ++mStats.stateChanges; }
+    void uniform(ci::gl::GlslProg&, const char*, const ci::Vec2f&) { ++mStats.stateChanges; }
+    void uniform(ci::gl::GlslProg&, const char*, const ci::ColorA&) { ++mStats.stateChanges; }
+    void bindTexture(ci::gl::Texture&) { ++mStats.stateChanges; }
+    void unbindTexture(ci::gl::Texture&) { ++mStats.stateChanges; }
+
+    void vertexArray(ci::gl::Vbo&, GLint, GLint, GLenum, bool, GLsizei, size_t, GLuint) { ++mStats.stateChanges; }
+    void disableArrays() { ++mStats.stateChanges; }
+
+    void drawElements(ci::gl::Vbo&, GLenum, GLsizei count, GLenum, GLsizei instances=0);
+    void drawRect(const ci::Rectf&) { draw(4); }
+    void drawTexture(ci::gl::Texture&, const ci::Vec2f&) { ++mStats.stateChanges; draw(4); }
+
+private:
+    bool        mInstancing;
+    GLint       mMaxTextureSize;
+    RenderStats mStats;
+
+    void upload(size_t bytes) { mStats.bytesUploaded += bytes; ++mStats.stateChanges; }
+    void draw(size_t vertices) { mStats.vertices += vertices; ++mStats.drawCalls; }
+};
+
+}
@@ -0,0 +1,213 @@
+#pragma once
+
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/smart_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include "RenderBackend.h"
+
+namespace netphy {
+
+/**
+  * One frame's render commands, recorded now and submitted later
+  *
+  * Every call a RenderBackend takes becomes a command, so a list recorded
+  * from the hex map, the gui quads and the label textures replays the same
+  * uploads, state changes and draws on another backend.  Upload data and
+  * matrices are copied in as they are recorded, so the list stays as it
+  * was whatever its sources do afterwards.  Buffers, textures and shaders
+  * are held by address and must outlive the submit.
+  *
+*/
+class RenderList
+{
+public:
+    RenderList() { }
+    ~RenderList() { }
+
+    void   clear();
+    size_t size() const { return mCommands.size(); }
+    size_t getDataSize() const { return mData.size(); }
+
+    //  Replay every command in order
+    void submit(RenderBackend& backend) const;
+
+private:
+    friend class RenderListBackend;
+
+    enum CommandType {
+        BUFFER_DATA,
+        BUFFER_SUB_DATA,
+        CREATE_TEXTURE,
+        CREATE_TEXTURE_SURFACE,
+        TEXTURE_SUB_IMAGE,
+        SET_MATRICES,
+        PUSH_MATRIX,
+        POP_MATRIX,
+        COLOR,
+        CLEAR,
+        BIND_SHADER,
+        UNBIND_SHADER,
+        UNIFORM_INT,
+        UNIFORM_FLOAT,
+        UNIFORM_VEC2,
+        UNIFORM_COLOR,
+        BIND_TEXTURE,
+        UNBIND_TEXTURE,
+        VERTEX_ARRAY,
+        DISABLE_ARRAYS,
+        DRAW_ELEMENTS,
+        DRAW_RECT,
+        DRAW_TEXTURE
+    };
+
+    //  Which fields a command uses depends on its type, see submit()
+    struct Command
+    {
+        CommandType type;
+        void*       object;         //  buffer, texture or shader
+        const char* name;           //  uniform name, a literal
+        GLenum      mode;
+        GLint       i[6];
+        float       f[4];
+        size_t      offset;
+        size_t      bytes;
+        size_t      data;           //  offset into mData, or NoData
+    };
+    static const size_t NoData = size_t(-1);
+
+    std::vector<Command>                    mCommands;
+    std::vector<char>                       mData;
+    std::vector<ci::Surface>                mSurfaces;
+    std::vector<ci::gl::Texture::Format>    mFormats;
+
+    Command& add(CommandType type, void* object=0);
+    size_t   copy(const void* data, size_t bytes);
+    const void* data(const Command& command) const;
+};
+
+//  Backend recording into a RenderList.  Capabilities come from the device
+//  the list will be submitted to, so draw paths choose as they would when
+//  drawing straight to it.
+class RenderListBackend : public RenderBackend
+{
+public:
+    RenderListBackend(RenderBackendPtr device);
+    ~RenderListBackend() { }
+
+    //  List the following commands go to
+    void record(RenderList* list) { mList = list; }
+
+    bool  hasContext() const { return mDevice->hasContext(); }
+    bool  hasInstancing() { return mDevice->hasInstancing(); }
+    GLint getMaxTextureSize() { return mDevice->getMaxTextureSize(); }
+    GLint attribLocation(ci::gl::GlslProg& shader, const char* name) { return mDevice->attribLocation(shader, name); }
+
+    void bufferData(ci::gl::Vbo& vbo, GLenum target, size_t bytes, const void* data, GLenum usage);
+    void bufferSubData(ci::gl::Vbo& vbo, size_t offset, size_t bytes, const void* data);
+    void createTexture(ci::gl::Texture& texture, int width, int height, const ci::gl::Texture::Format& format);
+    void createTexture(ci::gl::Texture& texture, const ci::Surface& surface);
+    void textureSubImage(ci::gl::Texture& texture, const ci::Area& area, int rowLength, GLenum format, const void* data);
+
+    using RenderBackend::setMatrices;
+    void setMatrices(const ci::Matrix44f& projection, const ci::Matrix44f& modelView);
+    void pushMatrix(const ci::Vec2f& translate);
+    void popMatrix();
+    void color(const ci::ColorA& color);
+    void clear(const ci::ColorA& color);
+    void bindShader(ci::gl::GlslProg& shader);
+    void unbindShader(ci::gl::GlslProg& shader);
+    void uniform(ci::gl::GlslProg& shader, const char* name, int value);
+    void uniform(ci::gl::GlslProg& shader, const char* name, float value);
+    void uniform(ci::gl::GlslProg& shader, const char* name, const ci::Vec2f& value);
+    void uniform(ci::gl::GlslProg& shader, const char* name, const ci::ColorA& value);
+    void bindTexture(ci::gl::Texture& texture);
+    void unbindTexture(ci::gl::Texture& texture);
+
+    void vertexArray(ci::gl::Vbo& vbo, GLint array, GLint components, GLenum type, bool normalize,
+                     GLsizei stride, size_t offset, GLuint divisor=0);
+    void disableArrays();
+
+    void drawElements(ci::gl::Vbo& indices, GLenum mode, GLsizei count, GLenum type, GLsizei instances=0);
+    void drawRect(const ci::Rectf& rect);
+    void drawTexture(ci::gl::Texture& texture, const ci::Vec2f& pos);
+
+private:
+    RenderBackendPtr mDevice;
+    RenderList*      mList;
+
+    void color(RenderList::CommandType type, const ci::ColorA& color);
+};
+typedef boost::shared_ptr<RenderListBackend> RenderListBackendPtr;
+
+/**
+  * Frames recorded on one side and submitted on the other
+  *
+  * Each frame records a scene list and a gui list through the recorder,
+  * drawn with the app's own matrices in between.  swap() hands the
+  * recorded frame over to be submitted and starts recording the next into
+  * the other pair of lists, so the frame being submitted is never written.
+  * Commands recorded before the first swap, at setup, go out with the
+  * first frame.
+  *
+  * The GL context stays with the thread that created it, so the app
+  * submits from its own thread and moves the simulation off it instead:
+  * simulate() runs a job on a worker while the frame is submitted, and
+  * wait() collects it before the next frame is recorded.  Recording and
+  * submitting never lock, the worker is only synchronised with once a
+  * frame.  Without threading the job runs inline.
+  *
+*/
+class RenderPipeline
+{
+public:
+    RenderPipeline(RenderBackendPtr device, bool threaded=true);
+    ~RenderPipeline();
+
+    //  Backend to draw with, recording into the frame being built
+    RenderBackendPtr getRecorder() { return mRecorder; }
+    RenderBackend&   getDevice() { return *mDevice; }
+
+    //  Record the following commands into the scene or gui list
+    void recordScene();
+    void recordGui();
+
+    //  Hand the recorded frame over for submitting and start the next
+    void swap();
+
+    //  Submit the last frame handed over to the device
+    void submitScene();
+    void submitGui();
+
+    //  Run a job on the worker, waiting for the last one first
+    void simulate(const boost::function<void ()>& job);
+    //  Wait until the worker has finished its job
+    void wait();
+
+private:
+    struct Frame
+    {
+        RenderList scene;
+        RenderList gui;
+    };
+
+    RenderBackendPtr     mDevice;
+    RenderListBackendPtr mRecorder;
+    Frame                mFrames[2];
+    int                  mFront;            //  frame being submitted
+
+    //  Worker
+    bool                        mThreaded;
+    boost::thread               mThread;
+    boost::mutex                mMutex;
+    boost::condition_variable   mCondition;
+    boost::function<void ()>    mJob;
+    bool                        mQuit;
+
+    Frame& back() { return mFrames[1 - mFront]; }
+    void   work();
+};
+typedef boost::shared_ptr<RenderPipeline> RenderPipelinePtr;
+
+}
@@ -21,7 +21,10 @@ public:
 
     virtual void enter() = 0;
     virtual void leave() = 0;
-    virtual void update() = 0;
+    //  Simulation step of dt seconds, run at the FrameScheduler's tick rate
+    virtual void tick(float dt) {}
+    //  Once a frame, after the frame's ticks
+    virtual void update() {}
     virtual void draw() = 0;
 
     //  Optional event handlers
@@ -48,6 +51,7 @@ public:
     void setActiveState(std::string stateName);
     StatePtr getActiveState() { return mActiveState; }
 
+    void tick(float dt);
     void update();
     void draw();
 
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cassert>
+#include <cstdlib>
 #include <string>
 #include <vector>
 
@@ -11,8 +13,10 @@
 #include "cinder/gl/Vbo.h"
 #include "cinder/gl/GlslProg.h"
 #include "cinder/Camera.h"
+#include "cinder/Timer.h"
 
 #include "GuiController.h"
+#include "RenderBackend.h"
 
 // XXX network packet types need a home
 #include "MessageIdentifiers.h"
@@ -24,6 +28,18 @@ namespace netphy {
 
 typedef ci::Vec2i HexCoord;
 
+//  Neighbour directions, in the order HexGrid::adjacent returns them
+enum HexDirection
+{
+    HEX_NW = 0,
+    HEX_N,
+    HEX_NE,
+    HEX_SE,
+    HEX_S,
+    HEX_SW,
+    HEX_DIRECTIONS
+};
+
 //  Adjacency check results
 struct HexAdjacent
 {
@@ -34,7 +50,6 @@ struct HexAdjacent
     HexCoord s;
     HexCoord sw;
 
-    std::vector<HexCoord> toVector();
     std::string toString();
 };
 
@@ -57,32 +72,56 @@ public:
     ~HexGrid() { };
 
     void setSpacing(double xspacing, double yspacing);
+    ci::Vec2f getSpacing() const;
 
     HexCoord  WorldToHex(ci::Vec3f worldPos);
     ci::Vec3f HexToWorld(HexCoord hexPos, bool scale=true);
 
+    //  Convert arrays of points at once, using SSE2 where available.  Results 
+    //  are identical to the single point versions.
+    void WorldToHex(const ci::Vec3f* worldPos, HexCoord* hexPos, size_t count);
+    void HexToWorld(const HexCoord* hexPos, ci::Vec3f* worldPos, size_t count, bool scale=true);
+
     HexAdjacent adjacent(HexCoord pos);
+
+    //  Neighbour (x, y) offsets for even and odd columns, indexed [x & 1][direction]
+    static const int NeighbourOffsets[2][HEX_DIRECTIONS][2];
+    static HexCoord neighbour(const HexCoord& pos, int direction)
+    {
+        const int* offset = NeighbourOffsets[pos.x & 1][direction];
+        return HexCoord(pos.x + offset[0], pos.y + offset[1]);
+    }
+
+    //  Number of steps between two cells, via the axial (cube) coordinates of 
+    //  each.  Odd columns are offset so axial y is y - floor(x / 2).
+    static int distance(const HexCoord& a, const HexCoord& b)
+    {
+        const int dx = b.x - a.x;
+        const int dy = (b.y - (b.x >> 1)) - (a.y - (a.x >> 1));
+        return (std::abs(dx) + std::abs(dy) + std::abs(dx + dy)) / 2;
+    }
 };
 
+class HexMap;
+
+//  Handle to a single cell of a HexMap.  Cells are not stored as objects,
+//  the handle reads and writes the map's per-cell arrays.  Writing through 
+//  the handle gives the cell storage if the map is chunked.
 class HexCell
 {
 public:
-    HexCell();
-    ~HexCell();
+    HexCell(HexMap& map, const HexCoord& pos) : mMap(&map), mPos(pos) { }
 
-    void setPos(HexCoord& pos);
-    void setColor(ci::Color& color);
-    ci::Color& getColor();
+    ci::Color getColor();
+    void setColor(const ci::Color& color);
     int getLand();
     void setLand(int land);
     int getOwner();
     void setOwner(int id);
 
 private:
-    HexCoord  mPos;
-    ci::Color mColor;
-    int       mLand;  //  0 for sea, 1 for land
-    int       mOwner; //  player owner ID
+    HexMap*  mMap;
+    HexCoord mPos;
 };
 
 class HexRegion
@@ -95,79 +134,596 @@ public:
     ~HexRegion() { }
 
     void addHexes(std::vector<HexCoord>& hexes);
+    void addHex(const HexCoord& hex) { mHexes.push_back(hex); }
+    std::vector<HexCoord>& hexes() { return mHexes; }
     void clear();
 };
 
+class HexLabeller;
+class HexRegionTracker;
+struct HexLabels;
+
+//  Region label changes reported by a HexMap that tracks regions
+struct HexRegionEvent
+{
+    enum Type {
+        CREATED,    //  new region, its cells are already labelled
+        CHANGED,    //  cells were added or removed
+        MERGED,     //  region joined the region labelled other, its label is now unused
+        REMOVED,    //  last cell removed, label is now unused
+        RESET       //  every label was recomputed, label is -1
+    };
+
+    Type type;
+    int  label;
+    int  other;
+};
+
+struct HexRegionCallback
+{
+    virtual void operator()(const HexRegionEvent& event) = 0;
+};
+typedef boost::shared_ptr<HexRegionCallback> HexRegionCallbackPtr;
+
+//  A per-cell array that either owns its storage or views memory owned by 
+//  someone else, such as a mapped map file.  A view is copied into owned 
+//  storage the first time it has to grow.
+template <typename T>
+class HexPlane
+{
+public:
+    HexPlane() : mData(0), mSize(0) { }
+
+    T& operator[](size_t i) { return mData[i]; }
+    const T& operator[](size_t i) const { return mData[i]; }
+    size_t size() const { return mSize; }
+
+    void assign(size_t size, const T& value)
+    {
+        mOwned.assign(size, value);
+        adopt();
+    }
+    void resize(size_t size, const T& value)
+    {
+        detach();
+        mOwned.resize(size, value);
+        adopt();
+    }
+    void view(T* data, size_t size)
+    {
+        std::vector<T>().swap(mOwned);
+        mData = data;
+        mSize = size;
+    }
+    //  Copy a view into owned storage
+    void detach()
+    {
+        if (mData != (mOwned.empty() ? 0 : &mOwned[0])) {
+            mOwned.assign(mData, mData + mSize);
+            adopt();
+        }
+    }
+
+private:
+    void adopt()
+    {
+        mData = mOwned.empty() ? 0 : &mOwned[0];
+        mSize = mOwned.size();
+    }
+
+    std::vector<T> mOwned;
+    T*             mData;
+    size_t         mSize;
+};
+
+class MappedFile;
+
+/**
+  * A rectangular map of hex cells
+  *
+  * Cells are stored row-major as a structure of arrays: packed land bits,
+  * one byte owner IDs and a separate display colour array that only the
+  * renderer reads.  Whole-map passes should walk cell indices (0..cellCount-1)
+  * rather than HexCoords, and bulk kernels can use the raw arrays directly.
+  *
+  * A chunked map instead stores cells in CHUNK_SIZE square chunks, given 
+  * storage the first time one of their cells is written.  Chunks are laid 
+  * out one after another in the order they were allocated, each row-major, 
+  * after a shared read-only empty chunk at index 0 that every unallocated 
+  * chunk reads from.  Large worlds that are mostly sea then only pay for 
+  * their land.  Index based kernels work unchanged on either layout as long 
+  * as they get positions and neighbours from the map.
+  *
+*/
 class HexMap
 {
 private:
     HexGrid& mHexGrid;
     ci::Vec2i mSize;
-    HexCell** mCells;
+
+    HexPlane<uint32_t>    mLand;    //  1 bit per cell, 0 for sea, 1 for land
+    HexPlane<uint8_t>     mOwners;  //  player owner ID
+    HexPlane<ci::Color8u> mColors;  //  display colour
+
+    //  Map file the planes view, copy-on-write so edits never reach the file
+    boost::shared_ptr<MappedFile> mFile;
+
+    //  Flood fill scratch, sized to the map and reused between queries
+    std::vector<uint32_t> mVisited;    //  visit epoch per cell
+    uint32_t              mVisitEpoch;
+    std::vector<int>      mStack;
+    std::vector<int>      mFill;
+
+    uint32_t beginVisit();
+    void fill(int start, const int* ring, std::vector<int>& result);
+
+    //  Region labelling, created on first use
+    boost::shared_ptr<HexLabeller> mLabeller;
+    boost::shared_ptr<HexLabels>   mLabels;
+    int mLabelThreads;
+
+    //  Incremental region labels, only while tracking
+    boost::shared_ptr<HexRegionTracker> mTracker;
+    int mBulkEdit;
+
+    void cellChanged(int index);
+
+    //  Cell index offsets to the neighbours of a cell, indexed by column parity 
+    //  and which map edges the cell lies on, 0 where a neighbour is off the map
+    int mNeighbourOffsets[2][16][HEX_DIRECTIONS];
+
+    void buildNeighbourOffsets();
+
+    //  Chunk directory, mChunkSlots maps each chunk to its storage slot (0 if 
+    //  it has none) and mResident lists the chunks in slots 1, 2, ...
+    bool             mChunked;
+    ci::Vec2i        mChunkCount;
+    std::vector<int> mChunkSlots;
+    std::vector<int> mResident;
+
+    //  Cell index offsets to the neighbours of a cell inside a chunk, by column parity
+    int mChunkOffsets[2][HEX_DIRECTIONS];
+
+    //  Map revision, the revision the map was last replaced in and the 
+    //  revision each chunk last changed in
+    uint32_t              mRevision;
+    uint32_t              mLayoutRevision;
+    std::vector<uint32_t> mChunkRevisions;
+
+    void allocateChunk(int chunk);
+    void resetDerived();
 
 public:
-    HexMap(HexGrid& grid, int width, int height);
+    enum {
+        CHUNK_SHIFT = 5,
+        CHUNK_SIZE  = 1 << CHUNK_SHIFT,
+        CHUNK_CELLS = CHUNK_SIZE * CHUNK_SIZE
+    };
+
+    HexMap(HexGrid& grid, int width, int height, bool chunked=false);
     ~HexMap();
 
-    HexCell& at(HexCoord& pos);
-    ci::Vec2i getSize();
+    HexCell at(const HexCoord& pos) { return HexCell(*this, pos); }
+    ci::Vec2i getSize() const;
+
+    //  Replace the map with a map file, see HexMapFile.h.  The file is mapped 
+    //  and cells are read straight from it, so loading costs the same for any 
+    //  map size.  Returns false, leaving the map untouched, if the file can't 
+    //  be read.
+    bool load(const std::string& path);
+    bool save(const std::string& path, bool colors=true);
+
+    //  Cell index of a valid map position.  On a chunked map a cell without 
+    //  storage maps into the empty chunk, which reads as sea and must not be 
+    //  written; allocate() returns an index that is safe to write.
+    int index(const HexCoord& pos) const
+    {
+        assert(pos.x >= 0 && pos.x < mSize.x && pos.y >= 0 && pos.y < mSize.y);
+        if (mChunked) {
+            return (mChunkSlots[chunkAt(pos)] << (2 * CHUNK_SHIFT)) | 
+                   ((pos.y & (CHUNK_SIZE-1)) << CHUNK_SHIFT) | (pos.x & (CHUNK_SIZE-1));
+        }
+        return pos.y * mSize.x + pos.x;
+    }
+    int allocate(const HexCoord& pos);
+    //  Whether a cell index has storage of its own, rather than the empty chunk
+    bool hasStorage(int index) const { return !mChunked || index >= CHUNK_CELLS; }
+    //  Position of a cell index, not valid for the empty chunk
+    HexCoord position(int index) const
+    {
+        if (mChunked) {
+            assert(index >= CHUNK_CELLS);
+            const HexCoord origin = chunkOrigin(mResident[(index >> (2 * CHUNK_SHIFT)) - 1]);
+            return HexCoord(origin.x + (index & (CHUNK_SIZE-1)), origin.y + ((index >> CHUNK_SHIFT) & (CHUNK_SIZE-1)));
+        }
+        return HexCoord(index % mSize.x, index / mSize.x);
+    }
+    //  Size of the cell index space, including the empty chunk and chunk 
+    //  cells past the map edge on a chunked map.  Those are always sea.
+    int cellCount() const
+    {
+        return mChunked ? int(mResident.size() + 1) * CHUNK_CELLS : mSize.x * mSize.y;
+    }
+
+    //  Chunks of CHUNK_SIZE square cells covering the map, numbered row-major.
+    //  Chunks with storage are all of them unless the map is chunked.
+    bool isChunked() const { return mChunked; }
+    ci::Vec2i getChunkCount() const { return mChunkCount; }
+    int chunkAt(const HexCoord& pos) const { return (pos.y >> CHUNK_SHIFT) * mChunkCount.x + (pos.x >> CHUNK_SHIFT); }
+    HexCoord chunkOrigin(int chunk) const 
+    { 
+        return HexCoord((chunk % mChunkCount.x) << CHUNK_SHIFT, (chunk / mChunkCount.x) << CHUNK_SHIFT); 
+    }
+    bool isResident(int chunk) const { return !mChunked || mChunkSlots[chunk] != 0; }
+    const std::vector<int>& residentChunks() const { return mResident; }
+    //  Chunk holding a cell index
+    int chunkOf(int index) const
+    {
+        return mChunked ? mResident[(index >> (2 * CHUNK_SHIFT)) - 1] : chunkAt(position(index));
+    }
+
+    //  Every land, owner or colour change bumps the map's revision and stamps 
+    //  the cell's chunk with it, so any number of consumers can find what 
+    //  changed since the revision they last saw.  Writes through the raw 
+    //  arrays are not tracked, call touch() after them.
+    uint32_t getRevision() const { return mRevision; }
+    //  Revision the whole map was last replaced in, by load().  Chunks may 
+    //  have lost their storage then, which changedChunks() can't report.
+    uint32_t getLayoutRevision() const { return mLayoutRevision; }
+    uint32_t chunkRevision(int chunk) const { return mChunkRevisions[chunk]; }
+    void touch(int index) { mChunkRevisions[chunkOf(index)] = ++mRevision; }
+    //  Append the chunks changed since a revision to out, in slot order
+    void changedChunks(uint32_t since, std::vector<int>& out) const;
+
+    //  Per-cell accessors by index
+    bool isLand(int index) const { return ((mLand[index >> 5] >> (index & 31)) & 1) != 0; }
+    void setLand(int index, bool land);
+    int  getOwner(int index) const { return mOwners[index]; }
+    void setOwner(int index, int owner);
+    ci::Color getColor(int index) const { return ci::Color(mColors[index]); }
+    void setColor(int index, const ci::Color& color)
+    {
+        assert(!mChunked || index >= CHUNK_CELLS);
+        mColors[index] = ci::Color8u(color);
+        touch(index);
+    }
+
+    //  Raw arrays for bulk kernels, cellCount() entries long (land is cellCount()/32 words, rounded up).
+    //  Changes through them are not tracked, see touch().
+    const uint32_t*    landBits() const { return &mLand[0]; }
+    uint8_t*           owners() { return &mOwners[0]; }
+    ci::Color8u*       colors() { return &mColors[0]; }
+
+    //  Index offsets to the six neighbours of cell (x, y) in direction order, 
+    //  0 for neighbours off the map.  For kernels that already know x and y, 
+    //  only on maps that are not chunked.
+    const int* neighbourOffsets(int x, int y) const
+    {
+        assert(!mChunked);
+        const int edges = (x == 0) | ((x == mSize.x-1) << 1) | ((y == 0) << 2) | ((y == mSize.y-1) << 3);
+        return mNeighbourOffsets[x & 1][edges];
+    }
+    //  Write the indices of the in-bounds neighbours of a cell to out, returns how many
+    int neighbours(int index, int* out) const;
+    //  Write the indices of all six neighbours in direction order, -1 where off the map
+    void adjacent(int index, int* out) const;
+    void adjacent(const HexCoord& pos, int* out) const;
 
     //  Find all connected cells belonging to a player
     std::vector<HexCoord> connected(HexCoord pos);
+    //  As above, but fills a caller supplied buffer and does not allocate once warmed up
+    void connected(const HexCoord& pos, std::vector<HexCoord>& result);
+    void connected(int start, std::vector<int>& result);
 
     //  XXX should move to WarGame
     //std::vector<int> countHexes();
 
     //  Check position lies on hex map
-    bool isValid(HexCoord& pos);
+    bool isValid(const HexCoord& pos) const
+    {
+        return (pos.x >= 0 && pos.y >= 0 && pos.x < mSize.x && pos.y < mSize.y);
+    }
     HexGrid& hexGrid() { return mHexGrid; }
+
+    //  Label every region on the map.  The labels are owned by the map and 
+    //  stay valid until the next call, or the next edit while tracking.
+    const HexLabels& labelRegions();
     std::vector<HexRegion> regions();
+    //  Worker threads for full relabels of large maps, 0 for all hardware 
+    //  threads.  Defaults to 1.
+    void setLabelThreads(int threads);
+
+    //  Keep region labels up to date on every land or owner change, so 
+    //  labelRegions() costs nothing and subscribers hear about each change
+    void trackRegions(bool enable);
+    bool isTrackingRegions() const { return mTracker.get() != 0; }
+    //  Subscribing starts tracking
+    void subscribe(HexRegionCallbackPtr callback);
+    void unsubscribe(HexRegionCallbackPtr callback);
+
+    //  Pause incremental tracking around edits touching many cells, the 
+    //  outermost endBulkEdit() relabels the whole map once
+    void beginBulkEdit();
+    void endBulkEdit();
 
 };
 typedef boost::shared_ptr<HexMap> HexMapPtr;
 
+inline ci::Color HexCell::getColor() { return mMap->getColor(mMap->index(mPos)); }
+inline int  HexCell::getLand() { return mMap->isLand(mMap->index(mPos)) ? 1 : 0; }
+inline int  HexCell::getOwner() { return mMap->getOwner(mMap->index(mPos)); }
+
+//  A cell without storage reads as the empty chunk, writing what it already 
+//  holds doesn't allocate a chunk for it
+inline void HexCell::setColor(const ci::Color& color)
+{
+    const int index = mMap->index(mPos);
+    const ci::Color8u value(color), held(mMap->colors()[index]);
+    if (mMap->hasStorage(index) || value.r != held.r || value.g != held.g || value.b != held.b) {
+        mMap->setColor(mMap->allocate(mPos), color);
+    }
+}
+inline void HexCell::setLand(int land)
+{
+    const int index = mMap->index(mPos);
+    if (mMap->hasStorage(index) || (land != 0) != mMap->isLand(index)) {
+        mMap->setLand(mMap->allocate(mPos), land != 0);
+    }
+}
+inline void HexCell::setOwner(int id)
+{
+    const int index = mMap->index(mPos);
+    if (mMap->hasStorage(index) || id != mMap->getOwner(index)) {
+        mMap->setOwner(mMap->allocate(mPos), id);
+    }
+}
+
+inline int HexMap::neighbours(int index, int* out) const
+{
+    int ring[HEX_DIRECTIONS];
+    if (mChunked) {
+        adjacent(index, ring);
+    }
+    else {
+        const int* offsets = neighbourOffsets(index % mSize.x, index / mSize.x);
+        for (int d=0; d < HEX_DIRECTIONS; ++d) {
+            ring[d] = offsets[d] ? index + offsets[d] : -1;
+        }
+    }
+
+    int count = 0;
+    for (int d=0; d < HEX_DIRECTIONS; ++d) {
+        if (ring[d] >= 0) {
+            out[count++] = ring[d];
+        }
+    }
+    return count;
+}
+
+inline void HexMap::adjacent(int index, int* out) const
+{
+    if (mChunked) {
+        //  neighbours of cells inside a chunk are in the same chunk, unless 
+        //  the map ends inside it.  The rest go through their positions.
+        const int x = index & (CHUNK_SIZE-1), y = (index >> CHUNK_SHIFT) & (CHUNK_SIZE-1);
+        if (x > 0 && x < CHUNK_SIZE-1 && y > 0 && y < CHUNK_SIZE-1) {
+            const HexCoord pos = position(index);
+            if (pos.x < mSize.x-1 && pos.y < mSize.y-1) {
+                const int* offsets = mChunkOffsets[x & 1];
+                for (int d=0; d < HEX_DIRECTIONS; ++d) {
+                    out[d] = index + offsets[d];
+                }
+                return;
+            }
+        }
+        adjacent(position(index), out);
+        return;
+    }
+
+    const int* offsets = neighbourOffsets(index % mSize.x, index / mSize.x);
+    for (int d=0; d < HEX_DIRECTIONS; ++d) {
+        out[d] = offsets[d] ? index + offsets[d] : -1;
+    }
+}
+
+//  Iterates the in-bounds neighbours of a map position without allocating
+//
+//      for (HexNeighbours it(map, pos); it.valid(); it.next()) { ... it.pos() ... }
+//
+class HexNeighbours
+{
+public:
+    HexNeighbours(const HexMap& map, const HexCoord& pos)
+        : mPos(pos), mDirection(-1)
+    {
+        map.adjacent(pos, mRing);
+        next();
+    }
+
+    bool valid() const { return mDirection < HEX_DIRECTIONS; }
+    void next()
+    {
+        while (++mDirection < HEX_DIRECTIONS && mRing[mDirection] < 0) ;
+    }
+
+    int direction() const { return mDirection; }
+    int index() const { return mRing[mDirection]; }
+    HexCoord pos() const { return HexGrid::neighbour(mPos, mDirection); }
+
+private:
+    HexCoord mPos;
+    int      mRing[HEX_DIRECTIONS];
+    int      mDirection;
+};
+
+//  Vertex of a chunk mesh in world space.  edge runs from 255 at the hex's 
+//  centre to 0 on its corners, marks are the cell's HexRender marks.
+struct HexVertex
+{
+    ci::Vec3f    position;
+    ci::ColorA8u color;
+    uint8_t      edge;
+    uint8_t      marks;
+    uint8_t      padding[2];
+};
+
+class HexCuller;
+
 class HexRender
 {
 private:
     ci::Vec2i         mWindowSize;
-    ci::gl::VboMesh   mHexMesh;
-    ci::gl::VboMesh   mHexOutlineMesh;
     ci::CameraPersp   mCamera;
     ci::Vec3f         mCameraTo;
+    //  The eye eases towards mCameraTo once a tick, frames draw it between 
+    //  where it was at the last two ticks
+    ci::Vec3f         mCameraFrom;
+    ci::Vec3f         mCameraAt;
 
-    //  Frustum culling
-    HexCoord         mBottomLeft;
-    HexCoord         mTopRight;
+    //  Cells in view, see HexCulling.h
+    boost::shared_ptr<HexCuller> mCuller;
 
+    //  Every upload, state change and draw goes through the backend
+    RenderBackendPtr  mBackend;
     ci::gl::GlslProg  mShader;
+    ci::Timer         mClock;       //  drives the selection pulse
 
     HexMap&  mHexMap;
     HexGrid& mHexGrid;
 
-    HexCoord mSelectedHex;
+    //  Cell marks drawn by the fill shaders, along with each hex's outline
+    enum {
+        HEX_HIGHLIGHTED = 1 << 0,
+        HEX_SELECTED    = 1 << 1
+    };
+
+    //  Marks per cell index of the map, and like the map's revisions the 
+    //  revision each chunk's marks last changed in.  Cells without storage 
+    //  can't be marked.
+    HexCoord              mSelectedHex;
+    std::vector<HexCoord> mHighlighted;
+    std::vector<uint8_t>  mMarks;
+    std::vector<uint32_t> mMarkRevisions;
+    uint32_t              mMarkRevision;
+    uint32_t              mMarkLayout;      //  map layout revision mMarks is for
+
+    //  Without instancing each map chunk is drawn from its own mesh of hexes 
+    //  in world space.  A mesh is built the first time its chunk is seen and 
+    //  rebuilt only when the chunk's cells or marks change, so a frame costs 
+    //  a draw per visible chunk and GPU memory grows with the chunks that 
+    //  have been looked at.  Every chunk shares the same index buffer.
+    struct ChunkMesh
+    {
+        ChunkMesh() : cells(0), revision(0), markRevision(0) { }
+
+        ci::gl::Vbo vertices;
+        int         cells;
+        uint32_t    revision;       //  chunk revision it was built from, 0 if never built
+        uint32_t    markRevision;
+    };
+    std::vector<ChunkMesh> mChunkMeshes;
+    ci::gl::Vbo            mChunkIndices;
+    ci::gl::GlslProg       mChunkShader;
+    GLint                  mChunkCellAttrib;
+    std::vector<int>       mVisibleChunks;
+
+    //  Scratch for building chunk meshes
+    std::vector<HexCoord>  mChunkCells;
+    std::vector<ci::Vec3f> mChunkWorld;
+    std::vector<HexVertex> mChunkVertices;
+
+    //  Instanced drawing draws runs of consecutive cell indices with one 
+    //  call.  mShader places each instance from its position in the run and 
+    //  reads it from mColorVbo and mMarkVbo, copies of the map's colour plane 
+    //  and of mMarks kept current by uploading only the chunks that changed.
+    //  mHexVertices holds a single hex around the origin, drawn with the 
+    //  first hex's indices of mChunkIndices.
+    bool        mCanInstance;
+    bool        mInstancing;
+    GLint       mEdgeAttrib;
+    GLint       mColorAttrib;
+    GLint       mMarkAttrib;
+    ci::gl::Vbo mHexVertices;
+    ci::gl::Vbo mColorVbo;
+    ci::gl::Vbo mMarkVbo;
+    size_t      mBufferCapacity;    //  cells the buffers have room for
+    uint32_t    mColorRevision;     //  map revision they were last synced to
+    uint32_t    mMarkSynced;        //  and mark revision
+
+    std::vector<int>                  mChangedChunks;
+    std::vector<std::pair<int, int> > mSpans;
+
+    //  Once the camera is further than mLodDistance from the map it is drawn 
+    //  as one quad.  mLodShader finds the hex under each fragment and reads 
+    //  its colour from mLodTexture, a texel per cell kept current by 
+    //  uploading the chunks that changed, so a frame costs the same for any 
+    //  map size.
+    bool              mCanLod;
+    float             mLodDistance;
+    ci::gl::GlslProg  mLodShader;
+    ci::gl::Texture   mLodTexture;
+    uint32_t          mLodRevision;
 
     void generateMeshes();
+    void setupChunks();
+    void setupInstancing();
+    void syncMarks();
+    void mark(const HexCoord& pos, uint8_t marks, bool set);
+    void setShading(ci::gl::GlslProg& shader);
+    void findVisibleChunks();
+    void buildChunkMesh(int chunk);
+    void drawChunks();
+    void chunkSpans(const std::vector<int>& chunks);
+    void syncBuffers();
+    void setupLod();
+    bool syncLodTexture();
+    void uploadLodChunk(int chunk);
+    bool drawLod();
+    void drawInstanced();
+    void drawInstances(int index, int count, const HexCoord& origin, int rowWidth);
 
 public:
-    HexRender(HexMap& map);
+    //  Draws through backend, or straight to GL without one
+    HexRender(HexMap& map, RenderBackendPtr backend=RenderBackendPtr());
     ~HexRender(); 
 
     void setup(ci::Vec2i wsize);
-    void update();
+    //  Move the camera for a simulation tick of dt seconds
+    void tick(float dt);
+    //  Place the camera alpha of the way from its previous tick to its last 
+    //  and cull the map for the frame
+    void update(float alpha=1.0f);
     
+    //  Draws the map with hex outlines and the selected and highlighted cells
     void drawHexes();
-    void drawSelection();
 
-    ///  Cast a ray from camera projection plane (u,v) onto hex grid's plane
-    ci::Vec3f raycastHexPlane(float u, float v);
+    //  Instancing is on by default where the context supports it
+    void setInstancing(bool enable) { mInstancing = enable && mCanInstance; }
+    bool isInstancing() const { return mInstancing; }
 
-    void setSelectedHex(HexCoord loc) { mSelectedHex = loc; }
+    //  Camera height above the map past which it is drawn as one textured 
+    //  quad, where the context supports it
+    void  setLodDistance(float distance) { mLodDistance = distance; }
+    float getLodDistance() const { return mLodDistance; }
+
+    const HexCuller& getCuller() const { return *mCuller; }
+    size_t getVisibleChunkCount() const { return mVisibleChunks.size(); }
+
+    void setSelectedHex(HexCoord loc);
     HexCoord getSelectedHex() { return mSelectedHex; }
 
+    //  Show a set of cells darkened, such as a territory
+    void setHighlight(const std::vector<HexCoord>& cells);
+    void clearHighlight();
+
     ci::Vec3f& getCameraTo() { return mCameraTo; }
     void setCameraTo(ci::Vec3f& cameraTo);
+    //  Put the camera's eye straight at a point, without easing there
+    void jumpCamera(const ci::Vec3f& eye);
 
     ci::Camera& getCamera();
+
+    RenderBackend& getBackend() { return *mBackend; }
 };
 typedef boost::shared_ptr<HexRender> HexRenderPtr;
 
@@ -269,6 +825,8 @@ public:
 typedef boost::shared_ptr<Mouse> MousePtr;
 
 class StateManager;
+class HexPicker;
+class FrameScheduler;
 
 //  Manages network input commands and updates game state (WarGame)
 class WargameServer
@@ -309,15 +867,16 @@ struct Shared
     HexMap&        hexMap;
     HexGrid&       hexGrid;
     HexRender&     hexRender;
+    RenderBackend& backend;     //  what states and the gui draw with
     GuiController& gui;
     GuiFactory&    guiFactory;
     Mouse&         mouse;
+    HexPicker&     picker;      //  the hovered hex, see HexPicking.h
+    FrameScheduler& scheduler;
     WarGame&       warGame;
 
-    GuiConsolePtr  console;   // XXX have to use a smart ptr here to attach/detach, 
-                              // but is there a cyclic dependency between Shared & console?
-                              // fix by not using pointers to attach/detach, generate uid's for widgets instead.
-    Shared(HexMap& hexmap, HexGrid& hexgrid, HexRender& hexrender, GuiController& gui, GuiFactory& factory, Mouse& mouse, WarGame& wargame, GuiConsolePtr console);
+    GuiConsolePtr  console;   //  shared with the gui while attached, which detaches by handle
+    Shared(HexMap& hexmap, HexGrid& hexgrid, HexRender& hexrender, RenderBackend& backend, GuiController& gui, GuiFactory& factory, Mouse& mouse, HexPicker& picker, FrameScheduler& scheduler, WarGame& wargame, GuiConsolePtr console);
 };
 
 }
@@ -111,9 +111,9 @@ static unsigned char GetPacketIdentifier(Packet *p)
 		return (unsigned char) p->data[0];
 }
 
-void ClientState::update()
+void ClientState::tick(float dt)
 {
-    GuiConsoleOutput cout = GG.console->output();
+    LogSink& log = GG.console->log();
 
 	Packet* p;
     unsigned char packetIdentifier;
@@ -131,68 +131,68 @@ void ClientState::update()
         {
         case ID_DISCONNECTION_NOTIFICATION:
             // Connection lost normally
-            cout << "ID_DISCONNECTION_NOTIFICATION\n";
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_DISCONNECTION_NOTIFICATION";
             break;
         case ID_ALREADY_CONNECTED:
             // Connection lost normally
-            cout << "ID_ALREADY_CONNECTED\n";
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_ALREADY_CONNECTED";
             break;
         case ID_INCOMPATIBLE_PROTOCOL_VERSION:
-            cout << "ID_INCOMPATIBLE_PROTOCOL_VERSION\n";
+            NETPHY_LOG(log, LEVEL_WARNING) << "ID_INCOMPATIBLE_PROTOCOL_VERSION";
             break;
         case ID_REMOTE_DISCONNECTION_NOTIFICATION: // Server telling the clients of another client disconnecting gracefully.  You can manually broadcast this in a peer to peer enviroment if you want.
-            cout << "ID_REMOTE_DISCONNECTION_NOTIFICATION\n"; 
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_REMOTE_DISCONNECTION_NOTIFICATION"; 
             break;
         case ID_REMOTE_CONNECTION_LOST: // Server telling the clients of another client disconnecting forcefully.  You can manually broadcast this in a peer to peer enviroment if you want.
-            cout << "ID_REMOTE_CONNECTION_LOST\n";
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_REMOTE_CONNECTION_LOST";
             break;
         case ID_REMOTE_NEW_INCOMING_CONNECTION: // Server telling the clients of another client connecting.  You can manually broadcast this in a peer to peer enviroment if you want.
-            cout << "ID_REMOTE_NEW_INCOMING_CONNECTION\n";
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_REMOTE_NEW_INCOMING_CONNECTION";
             break;
         case ID_CONNECTION_BANNED: // Banned from this server
-            cout << "We are banned from this server.\n";
+            NETPHY_LOG(log, LEVEL_INFO) << "We are banned from this server.";
             break;			
         case ID_CONNECTION_ATTEMPT_FAILED:
-            cout << "Connection attempt failed\n";
+            NETPHY_LOG(log, LEVEL_INFO) << "Connection attempt failed";
             break;
         case ID_NO_FREE_INCOMING_CONNECTIONS:
             // Sorry, the server is full.  I don't do anything here but
             // A real app should tell the user
-            cout << "ID_NO_FREE_INCOMING_CONNECTIONS\n";
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_NO_FREE_INCOMING_CONNECTIONS";
             break;
         case ID_MODIFIED_PACKET:
             // Cheater!
-            cout << "ID_MODIFIED_PACKET\n";
+            NETPHY_LOG(log, LEVEL_WARNING) << "ID_MODIFIED_PACKET";
             break;
 
         case ID_INVALID_PASSWORD:
-            cout << "ID_INVALID_PASSWORD\n";
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_INVALID_PASSWORD";
             break;
 
         case ID_CONNECTION_LOST:
             // Couldn't deliver a reliable packet - i.e. the other system was abnormally
             // terminated
-            cout << "ID_CONNECTION_LOST\n";
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_CONNECTION_LOST";
             break;
 
         case ID_CONNECTION_REQUEST_ACCEPTED:
             // This tells the client they have connected
-            cout << "ID_CONNECTION_REQUEST_ACCEPTED to " << p->systemAddress.ToString(true) << " with GUID " << p->guid.ToString() << endl;
-            cout << "My external address is " << mClient->GetExternalID(p->systemAddress).ToString(true) << endl;
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_CONNECTION_REQUEST_ACCEPTED to " << p->systemAddress.ToString(true) << " with GUID " << p->guid.ToString();
+            NETPHY_LOG(log, LEVEL_INFO) << "My external address is " << mClient->GetExternalID(p->systemAddress).ToString(true);
             break;
 
         case ID_START_GAME:
             bs = RakNet::BitStream(p->data, p->length, false);
             char packetTypeID;
-            cout << "Start game packet received" << endl;
+            NETPHY_LOG(log, LEVEL_INFO) << "Start game packet received";
             bs.Read(packetTypeID);
             stringCompressor->DecodeString(&incoming, 256, &bs);
-            cout << "String payload: " << incoming << endl;
+            NETPHY_LOG(log, LEVEL_INFO) << "String payload: " << incoming.C_String();
             break;
 
         default:
             // It's a client, so just show the message
-            cout << p->data;
+            log.write(LEVEL_INFO, (const char*) p->data, strlen((const char*) p->data));
             break;
         }
     }
@@ -201,7 +201,7 @@ void ClientState::update()
 
 void ClientState::draw()
 {
-    gl::clear( Color( 0.25f, 0.25f, 0.4f ) );
+    GG.backend.clear( Color( 0.25f, 0.25f, 0.4f ) );
 }
 
 void ClientState::mouseWheel(MouseEvent event)
@@ -217,7 +217,7 @@ void ClientState::keyDown(ci::app::KeyEvent event)
         mManager.setActiveState("title");
     }
     else if (keycode == app::KeyEvent::KEY_BACKQUOTE) {
-        // XXX should push console to the top of the gui widget list
+        //  attaching again brings it to the top
         GG.gui.attach(GG.console);
     }
 }
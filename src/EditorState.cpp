@@ -1,5 +1,8 @@
 #include "EditorState.h"
 #include "WarGame.h"
+#include "HexLabels.h"
+#include "HexPicking.h"
+#include "FrameScheduler.h"
 #include "cinder/Vector.h"
 #include "cinder/Rand.h"
 #include "cinder/gl/gl.h"
@@ -15,6 +18,9 @@ using std::string;
 
 static Rand random;
 
+//  Map file saved and loaded by the editor
+static const char* EditorMapFile = "editor.hexmap";
+
 EditorState::EditorState(StateManager& manager, Shared& shared) : State(manager, shared)
 {
 }
@@ -36,18 +42,28 @@ void EditorState::enter()
 
     mLabelBox = GG.gui.createBox(boxQuad, debugLabelBox, true);
     mLabelBox->addChild(mLabel);
+
+    //  Painting edits single cells, keep territories labelled as we go
+    GG.hexMap.trackRegions(true);
 }
 
 void EditorState::leave()
 {
     // mLabelBox->detach();
     GG.gui.detachAll();
+    GG.hexRender.clearHighlight();
+    GG.hexMap.trackRegions(false);
+}
+
+void EditorState::tick(float dt)
+{
+    GG.hexRender.tick(dt);
 }
 
 void EditorState::update()
 {
     Vec2f mousePos = GG.mouse.getPos();
-    Vec3f planeHit = GG.hexRender.raycastHexPlane(mousePos.x, mousePos.y);
+    const HexCoord& selectedHex = GG.picker.getHoveredHex();
 
     //  Pan the camera
     if (GG.mouse.getRight() == PRESSED) {
@@ -71,7 +87,6 @@ void EditorState::update()
 
     //  Set land
     if (GG.mouse.getLeft() == PRESSED) {
-        HexCoord selectedHex = GG.hexGrid.WorldToHex(planeHit);
         if (GG.hexMap.isValid(selectedHex)) {
             GG.hexMap.at(selectedHex).setColor(Color(1.0f, 1.0f, 0.8f));
             GG.hexMap.at(selectedHex).setLand(1);
@@ -79,21 +94,26 @@ void EditorState::update()
     }
 
     std::stringstream ss;
-    HexCoord selectedHex = GG.hexGrid.WorldToHex(planeHit);
     GG.hexRender.setSelectedHex(selectedHex);
     ss << "Hex:" << selectedHex; // << " World: " << planeHit;
+    if (GG.hexMap.isValid(selectedHex)) {
+        const HexLabels& labels = GG.hexMap.labelRegions();
+        int region = labels.labels[GG.hexMap.index(selectedHex)];
+        if (region >= 0) {
+            ss << " Region:" << region << " (" << labels.sizes[region] << " hexes)";
+        }
+    }
 
     GuiLabelData& labelData = mLabel->getData();
     labelData.Text = ss.str();
 
-    GG.hexRender.update();
+    GG.hexRender.update(GG.scheduler.getAlpha());
 }
 
 void EditorState::draw()
 {
-    gl::clear( Color( 0.3f, 0.3f, 0.3f ) );
+    GG.backend.clear( Color( 0.3f, 0.3f, 0.3f ) );
     GG.hexRender.drawHexes();
-    GG.hexRender.drawSelection();
 }
 
 void EditorState::mouseWheel(MouseEvent event)
@@ -105,10 +125,7 @@ void EditorState::mouseWheel(MouseEvent event)
 
 void EditorState::keyDown(ci::app::KeyEvent event)
 {
-    // XXX duplicate raycast
-    Vec2f pos = GG.mouse.getPos();
-    Vec3f planeHit = GG.hexRender.raycastHexPlane(pos.x, pos.y);
-    HexCoord selectedHex = GG.hexGrid.WorldToHex(planeHit);
+    const HexCoord selectedHex = GG.picker.getHoveredHex();
 
     int keycode = event.getCode();
 
@@ -130,17 +147,24 @@ void EditorState::keyDown(ci::app::KeyEvent event)
     }
     else if (keycode == app::KeyEvent::KEY_g) {
         //  Generate hex colors
-        Vec2i mapSize = GG.hexMap.getSize();
-        for (int iy=0; iy < mapSize.y; ++iy) {
-            for (int ix=0; ix < mapSize.x; ++ix) {
-                HexCell& cell = GG.hexMap.at(HexCoord(ix, iy));
-                if (cell.getLand()) {
-                    int playerID = random.nextInt(0, 5);
-                    cell.setOwner(playerID);
-                    cell.setColor(GG.warGame.getPlayers()[playerID].getColor());
-                }
+        HexMap& map = GG.hexMap;
+        vector<Player>& players = GG.warGame.getPlayers();
+        const int cells = map.cellCount();
+        map.beginBulkEdit();
+        for (int i=0; i < cells; ++i) {
+            if (map.isLand(i)) {
+                int playerID = random.nextInt(0, 5);
+                map.setOwner(i, playerID);
+                map.setColor(i, players[playerID].getColor());
             }
         }
+        map.endBulkEdit();
+    }
+    else if (keycode == app::KeyEvent::KEY_s) {
+        GG.hexMap.save(EditorMapFile);
+    }
+    else if (keycode == app::KeyEvent::KEY_l) {
+        GG.hexMap.load(EditorMapFile);
     }
     else if (keycode == app::KeyEvent::KEY_DELETE) {
         GG.hexMap.at(selectedHex).setLand(0);
@@ -149,15 +173,8 @@ void EditorState::keyDown(ci::app::KeyEvent event)
         mManager.setActiveState(string("game"));
     }
     else if (keycode == app::KeyEvent::KEY_c) {
-        vector<HexCoord> connected = GG.hexMap.connected(selectedHex);
-        for (vector<HexCoord>::iterator it = connected.begin(); it != connected.end(); ++it) {
-            HexCell& cell = GG.hexMap.at(*it);
-            Color cellColor = cell.getColor();
-            cellColor.r = 0.5f * cellColor.r;
-            cellColor.g = 0.5f * cellColor.g;
-            cellColor.b = 0.5f * cellColor.b;
-            cell.setColor(cellColor);
-        }
+        GG.hexMap.connected(selectedHex, mConnected);
+        GG.hexRender.setHighlight(mConnected);
     }
 }
 
@@ -0,0 +1,45 @@
+#include "FrameScheduler.h"
+
+#include <algorithm>
+
+using namespace netphy;
+
+FrameScheduler::FrameScheduler(double tickRate, double frameRate)
+    : mTickRate(tickRate), mFrameRate(frameRate), mMaxTicks(5), mStarted(false), mLastFrame(0),
+      mAccumulator(0), mTickCount(0)
+{
+}
+
+//  Leftover time is kept as a fraction of a tick, so the alpha of the
+//  current frame carries over to the new period
+void FrameScheduler::setTickRate(double rate)
+{
+    mAccumulator *= mTickRate / rate;
+    mTickRate = rate;
+}
+
+int FrameScheduler::beginFrame(double now)
+{
+    if (!mStarted) {
+        mStarted = true;
+        mLastFrame = now;
+        return 0;
+    }
+
+    mAccumulator += std::max(now - mLastFrame, 0.0);
+    mLastFrame = now;
+
+    const double period = 1.0 / mTickRate;
+    int ticks = int(mAccumulator / period);
+    if (ticks > mMaxTicks) {
+        //  too far behind to catch up, drop the backlog
+        ticks = mMaxTicks;
+        mAccumulator = 0;
+    }
+    else {
+        mAccumulator -= ticks * period;
+    }
+
+    mTickCount += ticks;
+    return ticks;
+}
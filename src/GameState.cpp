@@ -1,5 +1,6 @@
 #include "GameState.h"
 #include "WarGame.h"
+#include "FrameScheduler.h"
 #include "cinder/Vector.h"
 #include "cinder/Rand.h"
 #include "cinder/gl/gl.h"
@@ -33,11 +34,14 @@ void GameState::leave()
     GG.gui.detachAll();
 }
 
+void GameState::tick(float dt)
+{
+    GG.hexRender.tick(dt);
+}
+
 void GameState::update()
 {
     Vec2f mousePos = GG.mouse.getPos();
-    Vec3f planeHit = GG.hexRender.raycastHexPlane(mousePos.x, mousePos.y);
-    HexCoord selectedHex = GG.hexGrid.WorldToHex(planeHit);
 
     //  XXX copy-pasted from EditorState
 
@@ -61,12 +65,12 @@ void GameState::update()
         mDragStart = false;
     }
     
-    GG.hexRender.update();
+    GG.hexRender.update(GG.scheduler.getAlpha());
 }
 
 void GameState::draw()
 {
-    gl::clear( Color( 0, 0, 0 ) );
+    GG.backend.clear( Color( 0, 0, 0 ) );
     GG.hexRender.drawHexes();
 }
 
@@ -1,9 +1,10 @@
 #include "cinder/app/AppBasic.h"
 #include "cinder/Rand.h"
 #include "cinder/Vector.h"
-#include "cinder/Text.h"
 #include "boost/algorithm/string.hpp"
 
+#include <algorithm>
+
 #include "GuiController.h"
 
 using namespace ci;
@@ -16,54 +17,103 @@ using boost::shared_ptr;
 
 using namespace netphy;
 
-GuiController::GuiController()
+//  A handle is a slot index below its slot's generation
+static const uint32_t HandleIndexBits = 20;
+static const uint32_t HandleIndexMask = (1u << HandleIndexBits) - 1;
+static const uint32_t HandleGenerations = 1u << (32 - HandleIndexBits);
+
+GuiController::GuiController() : mBackend(new GlRenderBackend()), mHoles(0)
 {
 }
 
 void GuiController::update()
 {
-    list<GuiWidgetPtr> purged;
-    for (list<GuiWidgetPtr>::iterator it = mWidgets.begin(); it != mWidgets.end(); ++it) {
-        if (!(*it)->isPurged()) {
-            (*it)->update();
-        }
-        else {
-            purged.push_back(*it);
+    mReleased.clear();
+    compact();
+
+    //  widgets attached from here on are updated too
+    for (size_t i=0; i < mAttached.size(); ++i) {
+        if (mAttached[i]) {
+            mAttached[i]->update();
         }
     }
+}
 
-    for (list<GuiWidgetPtr>::iterator it = purged.begin(); it != purged.end(); ++it) {
-        (*it)->detach();
+void GuiController::draw()
+{
+    mText.begin();
+    for (size_t i=0; i < mAttached.size(); ++i) {
+        if (mAttached[i]) {
+            mAttached[i]->draw();
+        }
     }
+    mText.draw(*mBackend);
 }
 
-void GuiController::draw()
+//  Close the holes detaching left, keeping the order
+void GuiController::compact()
 {
-    for (list<GuiWidgetPtr>::iterator it = mWidgets.begin(); it != mWidgets.end(); ++it) {
-        if (!(*it)->isPurged()) {
-            (*it)->draw();
+    if (mHoles == 0) {
+        return;
+    }
+
+    size_t kept = 0;
+    for (size_t i=0; i < mAttached.size(); ++i) {
+        GuiWidget* widget = mAttached[i];
+        if (widget) {
+            mSlots[widget->mHandle & HandleIndexMask].order = uint32_t(kept);
+            mAttached[kept++] = widget;
         }
     }
+    mAttached.resize(kept);
+    mHoles = 0;
 }
 
-struct FindWidget {
-    GuiWidget* target;
-    FindWidget(GuiWidget* target) : target(target) { }
-    bool operator() (GuiWidgetPtr& widget) { return widget.get() == target; }
-};
+GuiWidget* GuiController::get(GuiHandle handle) const
+{
+    const uint32_t index = handle & HandleIndexMask;
+    if (index >= mSlots.size() || mSlots[index].generation != handle >> HandleIndexBits) {
+        return 0;
+    }
+    return mSlots[index].widget.get();
+}
 
-void GuiController::detach(GuiWidget* ptr)
+void GuiController::detach(GuiWidget* widget)
 {
-    list<GuiWidgetPtr>::iterator it = std::find_if(mWidgets.begin(), mWidgets.end(), FindWidget(ptr));
-    if (it != mWidgets.end()) {
-        mWidgets.erase(it);
+    detach(widget->mHandle);
+}
+
+void GuiController::detach(GuiHandle handle)
+{
+    GuiWidget* widget = get(handle);
+    if (!widget) {
+        return;
     }
+
+    const uint32_t index = handle & HandleIndexMask;
+    Slot& slot = mSlots[index];
+    mAttached[slot.order] = 0;
+    ++mHoles;
+
+    //  kept alive until the next update, it may be running now
+    mReleased.push_back(GuiWidgetPtr());
+    mReleased.back().swap(slot.widget);
+
+    slot.generation = slot.generation + 1 < HandleGenerations ? slot.generation + 1 : 1;
+    mFree.push_back(index);
+    widget->mHandle = 0;
 }
 
 void GuiController::detachAll()
 {
     //  release all root widgets
-    mWidgets.clear();
+    for (size_t i=0; i < mAttached.size(); ++i) {
+        if (mAttached[i]) {
+            detach(mAttached[i]->mHandle);
+        }
+    }
+    mAttached.clear();
+    mHoles = 0;
 }
 
 GuiLabelWidgetPtr GuiController::createLabel(const GuiLabelData& spec, bool attachWidget)
@@ -109,17 +159,34 @@ GuiBoxWidgetPtr GuiController::createBox(const GuiQuadData& data, const GuiBoxDa
 }
 
 
-void GuiController::attach(GuiWidgetPtr widget)
+GuiHandle GuiController::attach(GuiWidgetPtr widget)
 {
-    //  ensure the widget is not purged before attaching
-    widget->purge(false);
-    mWidgets.push_back(widget);
+    detach(widget->mHandle);
+
+    uint32_t index;
+    if (mFree.empty()) {
+        assert("Too many gui widgets" && mSlots.size() <= HandleIndexMask);
+        index = uint32_t(mSlots.size());
+        mSlots.push_back(Slot());
+        mSlots.back().generation = 1;
+    }
+    else {
+        index = mFree.back();
+        mFree.pop_back();
+    }
+
+    Slot& slot = mSlots[index];
+    slot.widget = widget;
+    slot.order = uint32_t(mAttached.size());
+    mAttached.push_back(widget.get());
+    widget->mHandle = (slot.generation << HandleIndexBits) | index;
+    return widget->mHandle;
 }
 
 bool GuiController::keyDown(KeyEvent event)
 {
-    for (list<GuiWidgetPtr>::iterator it=mWidgets.begin(); it != mWidgets.end(); ++it) {
-        if ((*it)->keyDown(event)) {
+    for (size_t i=0; i < mAttached.size(); ++i) {
+        if (mAttached[i] && mAttached[i]->keyDown(event)) {
             return true;
         }
     }
@@ -128,15 +195,17 @@ bool GuiController::keyDown(KeyEvent event)
 
 void GuiController::mouseMove(MouseEvent event)
 {
-    for (list<GuiWidgetPtr>::iterator it=mWidgets.begin(); it != mWidgets.end(); ++it) {
-        (*it)->mouseMove(event);
+    for (size_t i=0; i < mAttached.size(); ++i) {
+        if (mAttached[i]) {
+            mAttached[i]->mouseMove(event);
+        }
     }
 }
 
 bool GuiController::mouseDown(MouseEvent event)
 {
-    for (list<GuiWidgetPtr>::iterator it=mWidgets.begin(); it != mWidgets.end(); ++it) {
-        if ((*it)->mouseDown(event)) {
+    for (size_t i=0; i < mAttached.size(); ++i) {
+        if (mAttached[i] && mAttached[i]->mouseDown(event)) {
             return true;
         }
     }
@@ -145,8 +214,8 @@ bool GuiController::mouseDown(MouseEvent event)
 
 bool GuiController::mouseUp(MouseEvent event)
 {
-    for (list<GuiWidgetPtr>::iterator it=mWidgets.begin(); it != mWidgets.end(); ++it) {
-        if ((*it)->mouseUp(event)) {
+    for (size_t i=0; i < mAttached.size(); ++i) {
+        if (mAttached[i] && mAttached[i]->mouseUp(event)) {
             return true;
         }
     }
@@ -196,21 +265,23 @@ void GuiWidget::draw()
 {
     // XXX problem with push/pop of matrix stack and GL transforms
 
-    glPushMatrix();
-    gl::translate(getPos());
+    RenderBackend& backend = mGui.getBackend();
+    backend.pushMatrix(getPos());
+    mGui.translate(getPos());
     drawImpl();
     //  Draw children
-    for (list<GuiWidgetPtr>::iterator it = mChildren.begin(); it != mChildren.end(); ++it) {
-        (*it)->draw();
+    for (size_t i=0; i < mChildren.size(); ++i) {
+        mChildren[i]->draw();
     }
-    glPopMatrix();
+    mGui.translate(-getPos());
+    backend.popMatrix();
 }
 
 void GuiWidget::update()
 {
     //  Update children first, so parents can perform layout based on child dimensions
-    for (list<GuiWidgetPtr>::iterator it = mChildren.begin(); it != mChildren.end(); ++it) {
-        (*it)->update();
+    for (size_t i=0; i < mChildren.size(); ++i) {
+        mChildren[i]->update();
     }
     updateImpl();
 }
@@ -237,7 +308,8 @@ void GuiWidget::signal(string name)
 
 GuiLabelWidget::GuiLabelWidget(GuiController& gui, const GuiLabelData& spec)
 : GuiWidget(gui),
-  mData(spec)
+  mData(spec),
+  mDirty(true)
 {
 }
 
@@ -245,28 +317,22 @@ GuiLabelWidget::~GuiLabelWidget()
 {
 }
 
+//  Text is measured only when what would be drawn changes, glyphs new to
+//  the atlas are rasterised on the way
 void GuiLabelWidget::updateImpl()
 {
-    TextLayout layout;
-    layout.setFont(Font(mData.Font, mData.FontSize));
-    layout.setColor(mData.FgColor);
-    if (!mData.Text.empty()) {
-        boost::split(mText, mData.Text, boost::is_any_of("\n"));
-        for (vector<string>::iterator it = mText.begin(); it != mText.end(); ++it) {
-            layout.addLine(*it);
-        }
+    if (!mDirty && mData.rendersAs(mRendered)) {
+        return;
     }
-    mTexture = gl::Texture(layout.render(true));
-    mSize = mTexture.getSize();
-    mTexture.unbind();
+
+    mSize = mGui.getText().measure(mData.Text, mData.Font, mData.FontSize);
+    mRendered = mData;
+    mDirty = false;
 }
 
 void GuiLabelWidget::drawImpl()
 {
-    gl::color(ColorA(1, 1, 1, 1));
-    mTexture.bind();
-    gl::draw(mTexture, Vec2f::zero());
-    mTexture.unbind();
+    mGui.getText().add(mData.Text, mData.Font, mData.FontSize, mData.FgColor, mGui.getOrigin());
 }
 
 GuiButtonWidget::GuiButtonWidget(GuiController& gui)
@@ -358,8 +424,9 @@ void GuiQuadWidget::updateImpl()
 
 void GuiQuadWidget::drawImpl()
 {
-    gl::color(mData.Color);
-    gl::drawSolidRect(mData.Rect, false);
+    RenderBackend& backend = mGui.getBackend();
+    backend.color(mData.Color);
+    backend.drawRect(mData.Rect);
 }
 
 GuiBoxWidget::GuiBoxWidget(GuiController& gui, const GuiQuadData& quadData, const GuiBoxData& boxData)
@@ -480,6 +547,94 @@ string ConsoleInputBuffer::getInput()
     return mInput;
 }
 
+ConsoleScrollback::ConsoleScrollback(size_t lineCapacity, size_t byteCapacity)
+    : mBytes(std::max(byteCapacity, size_t(1))), mLines(std::max(lineCapacity, size_t(1)))
+{
+    clear();
+}
+
+void ConsoleScrollback::clear()
+{
+    mFirst = 0;
+    mCount = 0;
+    mTail = 0;
+    mHead = 0;
+}
+
+void ConsoleScrollback::append(const char* text, size_t length)
+{
+    if (mCount == 0) {
+        newLine();
+    }
+
+    const char* end = text + length;
+    for (;;) {
+        const char* newline = std::find(text, end, '\n');
+        appendToLine(text, newline - text);
+        if (newline == end) {
+            break;
+        }
+        newLine();
+        text = newline + 1;
+    }
+}
+
+void ConsoleScrollback::newLine()
+{
+    if (mCount == mLines.size()) {
+        dropOldest();
+    }
+    Line& line = mLines[(mFirst + mCount++) % mLines.size()];
+    line.start = mHead;
+    line.length = 0;
+}
+
+void ConsoleScrollback::appendToLine(const char* text, size_t length)
+{
+    const size_t capacity = mBytes.size();
+    if (length > capacity) {
+        text += length - capacity;
+        length = capacity;
+    }
+
+    //  make room, cutting the front off the last line if it is the only one left
+    while (mHead + length - mTail > capacity && mCount > 1) {
+        dropOldest();
+    }
+    Line& last = mLines[(mFirst + mCount - 1) % mLines.size()];
+    if (mHead + length - mTail > capacity) {
+        const size_t cut = size_t(mHead + length - mTail - capacity);
+        last.start += cut;
+        last.length -= cut;
+        mTail = last.start;
+    }
+
+    //  in at most two pieces, either side of the end of the ring
+    const size_t at = size_t(mHead % capacity);
+    const size_t first = std::min(length, capacity - at);
+    std::copy(text, text + first, mBytes.begin() + at);
+    std::copy(text + first, text + length, mBytes.begin());
+    mHead += length;
+    last.length += length;
+}
+
+void ConsoleScrollback::dropOldest()
+{
+    mFirst = (mFirst + 1) % mLines.size();
+    --mCount;
+    mTail = mCount ? mLines[mFirst].start : mHead;
+}
+
+void ConsoleScrollback::getLine(size_t index, string& text) const
+{
+    const Line& line = mLines[(mFirst + index) % mLines.size()];
+    const size_t capacity = mBytes.size();
+    const size_t at = size_t(line.start % capacity);
+    const size_t first = std::min(line.length, capacity - at);
+    text.assign(mBytes.begin() + at, mBytes.begin() + at + first);
+    text.append(mBytes.begin(), mBytes.begin() + (line.length - first));
+}
+
 GuiConsolePtr GuiFactory::createConsole(int lines, float fontSize, bool attach)
 {
     GuiConsolePtr console(new GuiConsole(mGui, lines, fontSize));
@@ -491,7 +646,7 @@ GuiConsolePtr GuiFactory::createConsole(int lines, float fontSize, bool attach)
 
 //  linecount includes the bottom input line
 GuiConsole::GuiConsole(GuiController& gui, int lineCount, float fontSize)
-    : GuiWidget(gui), mLineCount(lineCount-1), mStream(*this) // , mInputBuffer("")
+    : GuiWidget(gui), mLineCount(lineCount-1), mScroll(0), mStream(*this) // , mInputBuffer("")
 {
     GuiLabelData labelData;
     labelData.Font = "Droid Sans Mono";
@@ -511,32 +666,20 @@ GuiConsole::GuiConsole(GuiController& gui, int lineCount, float fontSize)
 
 void GuiConsole::appendString(const std::string& text)
 {
-    if (mBuffer.empty()) {
-        mBuffer.push_back(std::string(""));
-    }
+    append(text.data(), text.size());
+}
 
-    string& last = mBuffer.back();
-    vector<string> lines;
-    boost::split(lines, text, boost::is_any_of("\n"));
-    for (vector<string>::iterator it = lines.begin(); it != lines.end(); ++it) {
-        if (it == lines.begin()) {
-            //  append to last line in buffer
-            std::stringstream ss;
-            ss << last << (*it);
-            last = ss.str();
-        }
-        else {
-            //  append to new line
-            mBuffer.push_back(*it);
-        }
+void GuiConsole::append(const char* text, size_t length)
+{
+    //  split so nothing is cut to fit a log slot
+    for (size_t done = 0; done < length; done += LogSink::SlotText) {
+        mLog.write(LEVEL_INFO, text + done, std::min(length - done, size_t(LogSink::SlotText)));
     }
 }
 
 std::streamsize GuiConsoleStream::write(const char* s, std::streamsize n)
 {
-    string fragment(s, s + n);
-    // mConsole.addString(fragment);
-    mConsole.appendString(fragment);
+    mConsole.append(s, size_t(n));
     return n;
 }
 
@@ -549,18 +692,11 @@ void GuiConsole::updateImpl()
 {
     assert(mLineCount > 0 && mLineCount < 512);
 
-    //  set mConsoleStart to beginning of display buffer
-    if (!mBuffer.empty()) {
-        int linecount = mLineCount;
-        for (mConsoleStart = --(mBuffer.end()); 
-             linecount-- && mConsoleStart != mBuffer.begin();
-             --mConsoleStart) ;
-    }
-    else {
-        mConsoleStart = mBuffer.begin();
-    }
+    //  the newest lines that fit, less any scrolled back, oldest at the top
+    setScroll(mScroll);
+    const int count = int(mScrollback.getLineCount());
+    int line = std::max(count - mLineCount - mScroll, 0);
 
-    list<string>::iterator buf = mConsoleStart;
     const float lineSpacing = 1.0f;
     float yy = 0;
     float lineHeight = mInputLine->getSize().y;
@@ -571,11 +707,11 @@ void GuiConsole::updateImpl()
         (*it)->setPos(Vec2f(0, yy));
         yy += lineSpacing + lineHeight;
 
-        if (buf != mBuffer.end()) {
-            labelData.Text = *buf++;
+        if (line < count) {
+            mScrollback.getLine(line++, labelData.Text);
         }
         else {
-            labelData.Text = "";
+            labelData.Text.clear();
         }
     }
 
@@ -594,13 +730,34 @@ void GuiConsole::drawImpl()
 {
     //  drawing automatically triggered on child widgets
     Vec2f size(getSize());
-    gl::color(ColorA(0.1f, 0.1f, 0.2f, 0.8));
-    gl::drawSolidRect(Rectf(0, 0, size.x, size.y));
+    RenderBackend& backend = mGui.getBackend();
+    backend.color(ColorA(0.1f, 0.1f, 0.2f, 0.8));
+    backend.drawRect(Rectf(0, 0, size.x, size.y));
 }
 
+//  Lines logged for a console that was cleared since
+struct DiscardLog : public LogTarget
+{
+    virtual void write(LogLevel level, const char* text, size_t length) { }
+};
+
 void GuiConsole::clear()
 {
-    mBuffer.clear();
+    DiscardLog discard;
+    mLog.drain(discard);
+    mScrollback.clear();
+    mScroll = 0;
+}
+
+void GuiConsole::setScrollbackCapacity(size_t lines, size_t bytes)
+{
+    mScrollback = ConsoleScrollback(lines, bytes);
+    mScroll = 0;
+}
+
+void GuiConsole::setScroll(int lines)
+{
+    mScroll = std::max(std::min(lines, int(mScrollback.getLineCount()) - mLineCount), 0);
 }
 
 void GuiConsole::setWidth(float width)
@@ -610,9 +767,6 @@ void GuiConsole::setWidth(float width)
 
 bool GuiConsole::keyDown(KeyEvent event)
 {
-    // XXX shouldn't have to write this for every widget
-    if (isPurged()) return false;
-
     char ch = event.getChar();
     int keycode = event.getCode();
     bool ret = true;
@@ -629,13 +783,17 @@ bool GuiConsole::keyDown(KeyEvent event)
         signal("textInput");
     }
     else if (keycode == app::KeyEvent::KEY_BACKQUOTE) {
-        // XXX can't detach because it modifies the 
-        // detach();
-        purge();
+        detach();
     }
     else if (keycode == app::KeyEvent::KEY_BACKSPACE) {
         mConsoleBuffer.backspace();
     }
+    else if (keycode == app::KeyEvent::KEY_PAGEUP) {
+        setScroll(mScroll + mLineCount);
+    }
+    else if (keycode == app::KeyEvent::KEY_PAGEDOWN) {
+        setScroll(mScroll - mLineCount);
+    }
     else if (keycode >= app::KeyEvent::KEY_SPACE && keycode < app::KeyEvent::KEY_DELETE) {
         mConsoleBuffer.insertCharAtCursor(ch);
         //mInputBuffer << ch;
@@ -0,0 +1,228 @@
+#include "cinder/Text.h"
+
+#include "GuiText.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace ci;
+using namespace netphy;
+using std::string;
+
+//  Space left around glyphs, so filtering doesn't bleed in their neighbours
+static const int GlyphPadding = 1;
+
+//  Text rasterised in white, the colour comes from the vertices
+static Surface rasterise(const Font& font, const string& text)
+{
+    TextLayout layout;
+    layout.setFont(font);
+    layout.setColor(ColorA(1.0f, 1.0f, 1.0f, 1.0f));
+    layout.addLine(text);
+    return layout.render(true);
+}
+
+GuiGlyphAtlas::GuiGlyphAtlas(int size)
+    : mSize(size), mPixels(size, size, true, SurfaceChannelOrder::RGBA), mCreated(false)
+{
+    memset(mPixels.getData(), 0, mPixels.getRowBytes() * mPixels.getHeight());
+    clear();
+}
+
+void GuiGlyphAtlas::clear()
+{
+    for (FaceMap::iterator it = mFaces.begin(); it != mFaces.end(); ++it) {
+        for (int i=0; i < 256; ++i) {
+            Glyph& glyph = it->second.glyphs[i];
+            glyph.placed = false;
+            glyph.area = Area(0, 0, 0, 0);
+        }
+    }
+    mCursor = Vec2i(GlyphPadding, GlyphPadding);
+    mShelfHeight = 0;
+    mFull = false;
+    mDirty = Area(0, 0, 0, 0);
+}
+
+GuiGlyphAtlas::Face& GuiGlyphAtlas::face(const string& font, float size)
+{
+    const std::pair<string, float> key(font, size);
+    FaceMap::iterator it = mFaces.find(key);
+    if (it != mFaces.end()) {
+        return it->second;
+    }
+
+    Face& face = mFaces[key];
+    face.font = Font(font, size);
+    const Surface pipes = rasterise(face.font, "||");
+    face.pipes = float(pipes.getWidth());
+    face.lineHeight = float(pipes.getHeight());
+    return face;
+}
+
+//  A glyph's advance is how much it widens the text between two pipes,
+//  which counts spaces and side bearings the glyph's own image leaves out
+const GuiGlyphAtlas::Glyph& GuiGlyphAtlas::glyph(Face& face, char ch)
+{
+    Glyph& glyph = face.glyphs[uint8_t(ch)];
+    if (!glyph.measured) {
+        glyph.advance = rasterise(face.font, "|" + string(1, ch) + "|").getWidth() - face.pipes;
+        glyph.measured = true;
+    }
+
+    //  a glyph left out of a full atlas is tried again once it starts over
+    if (!glyph.placed && !mFull) {
+        if (ch != ' ') {
+            place(rasterise(face.font, string(1, ch)), glyph.area);
+        }
+        glyph.placed = !mFull;
+    }
+    return glyph;
+}
+
+void GuiGlyphAtlas::place(const Surface& image, Area& area)
+{
+    const int width = image.getWidth();
+    const int height = image.getHeight();
+    if (mCursor.x + width + GlyphPadding > mSize) {
+        mCursor = Vec2i(GlyphPadding, mCursor.y + mShelfHeight + GlyphPadding);
+        mShelfHeight = 0;
+    }
+    if (width + 2 * GlyphPadding > mSize || mCursor.y + height + GlyphPadding > mSize) {
+        mFull = true;
+        return;
+    }
+
+    area = Area(mCursor.x, mCursor.y, mCursor.x + width, mCursor.y + height);
+    mPixels.copyFrom(image, image.getBounds(), mCursor);
+    mCursor.x += width + GlyphPadding;
+    mShelfHeight = std::max(mShelfHeight, height);
+
+    if (mDirty.getWidth() == 0) {
+        mDirty = area;
+    }
+    else {
+        mDirty = Area(std::min(mDirty.x1, area.x1), std::min(mDirty.y1, area.y1),
+                      std::max(mDirty.x2, area.x2), std::max(mDirty.y2, area.y2));
+    }
+}
+
+void GuiGlyphAtlas::beginFrame()
+{
+    if (mFull) {
+        clear();
+    }
+}
+
+void GuiGlyphAtlas::sync(RenderBackend& backend)
+{
+    if (!mCreated) {
+        gl::Texture::Format format;
+        format.setInternalFormat(GL_RGBA);
+        format.setMinFilter(GL_LINEAR);
+        format.setMagFilter(GL_LINEAR);
+        backend.createTexture(mTexture, mSize, mSize, format);
+        mDirty = Area(0, 0, mSize, mSize);
+        mCreated = true;
+    }
+
+    if (mDirty.getWidth() > 0) {
+        backend.textureSubImage(mTexture, mDirty, mSize, GL_RGBA, mPixels.getData(Vec2i(mDirty.x1, mDirty.y1)));
+        mDirty = Area(0, 0, 0, 0);
+    }
+}
+
+GuiText::GuiText() : mQuadCapacity(0)
+{
+}
+
+Vec2f GuiText::measure(const string& text, const string& font, float size)
+{
+    GuiGlyphAtlas::Face& face = mAtlas.face(font, size);
+    float width = 0, line = 0;
+    int lines = 1;
+    for (string::const_iterator it = text.begin(); it != text.end(); ++it) {
+        if (*it == '\n') {
+            line = 0;
+            ++lines;
+            continue;
+        }
+        line += mAtlas.glyph(face, *it).advance;
+        width = std::max(width, line);
+    }
+    return Vec2f(width, lines * face.lineHeight);
+}
+
+void GuiText::begin()
+{
+    mAtlas.beginFrame();
+    mVertices.clear();
+}
+
+void GuiText::add(const string& text, const string& font, float size, const ColorA& color, const Vec2f& pos)
+{
+    GuiGlyphAtlas::Face& face = mAtlas.face(font, size);
+    const Vec2f atlasSize = mAtlas.getSize();
+    const ColorA8u tint(uint8_t(color.r * 255), uint8_t(color.g * 255), uint8_t(color.b * 255), uint8_t(color.a * 255));
+
+    Vec2f pen = pos;
+    for (string::const_iterator it = text.begin(); it != text.end(); ++it) {
+        if (*it == '\n') {
+            pen = Vec2f(pos.x, pen.y + face.lineHeight);
+            continue;
+        }
+
+        const GuiGlyphAtlas::Glyph& glyph = mAtlas.glyph(face, *it);
+        const Area& area = glyph.area;
+        if (area.getWidth() > 0) {
+            const float u1 = area.x1 / atlasSize.x, u2 = area.x2 / atlasSize.x;
+            const float v1 = area.y1 / atlasSize.y, v2 = area.y2 / atlasSize.y;
+            const float x2 = pen.x + area.getWidth(), y2 = pen.y + area.getHeight();
+            TextVertex quad[4] = {
+                { pen,               Vec2f(u1, v1), tint },
+                { Vec2f(x2, pen.y),  Vec2f(u2, v1), tint },
+                { Vec2f(x2, y2),     Vec2f(u2, v2), tint },
+                { Vec2f(pen.x, y2),  Vec2f(u1, v2), tint }
+            };
+            mVertices.insert(mVertices.end(), quad, quad + 4);
+        }
+        pen.x += glyph.advance;
+    }
+}
+
+//  Quads share an index buffer, grown with the most text a frame has held
+void GuiText::draw(RenderBackend& backend)
+{
+    mAtlas.sync(backend);
+    if (mVertices.empty()) {
+        return;
+    }
+
+    const size_t quads = mVertices.size() / 4;
+    if (quads > mQuadCapacity) {
+        mQuadCapacity = std::max(quads, mQuadCapacity * 2);
+        std::vector<uint32_t> indices;
+        indices.reserve(mQuadCapacity * 6);
+        for (uint32_t quad=0; quad < mQuadCapacity; ++quad) {
+            const uint32_t first = quad * 4;
+            const uint32_t corners[6] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+            indices.insert(indices.end(), corners, corners + 6);
+        }
+        backend.bufferData(mIndexVbo, GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint32_t), &indices[0], GL_STATIC_DRAW);
+    }
+
+    const size_t bytes = mVertices.size() * sizeof(TextVertex);
+    if (mVertices.size() != mUploaded.size() || memcmp(&mVertices[0], &mUploaded[0], bytes) != 0) {
+        backend.bufferData(mVertexVbo, GL_ARRAY_BUFFER, bytes, &mVertices[0], GL_STREAM_DRAW);
+        mUploaded = mVertices;
+    }
+
+    backend.color(ColorA(1.0f, 1.0f, 1.0f, 1.0f));
+    backend.bindTexture(mAtlas.getTexture());
+    backend.vertexArray(mVertexVbo, RenderBackend::POSITION_ARRAY, 2, GL_FLOAT, false, sizeof(TextVertex), 0);
+    backend.vertexArray(mVertexVbo, RenderBackend::TEXCOORD_ARRAY, 2, GL_FLOAT, false, sizeof(TextVertex), sizeof(Vec2f));
+    backend.vertexArray(mVertexVbo, RenderBackend::COLOR_ARRAY, 4, GL_UNSIGNED_BYTE, true, sizeof(TextVertex), 2 * sizeof(Vec2f));
+    backend.drawElements(mIndexVbo, GL_TRIANGLES, GLsizei(quads * 6), GL_UNSIGNED_INT);
+    backend.disableArrays();
+    backend.unbindTexture(mAtlas.getTexture());
+}
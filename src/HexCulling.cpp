@@ -0,0 +1,111 @@
+#include "HexCulling.h"
+
+#include <algorithm>
+#include <cfloat>
+
+using namespace ci;
+using namespace netphy;
+
+HexCuller::HexCuller() : mFirstColumn(0), mMin(0, 0), mMax(-1, -1), mVisibleCount(0)
+{
+}
+
+void HexCuller::update(const Camera& camera, const HexGrid& grid, const Vec2i& mapSize)
+{
+    static const float corners[4][2] = { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+
+    for (int i=0; i < 4; ++i) {
+        Ray ray = camera.generateRay(corners[i][0], corners[i][1], camera.getAspectRatio());
+        const Vec3f& origin = ray.getOrigin();
+        const Vec3f& dir = ray.getDirection();
+        const float t = dir.z < 0 ? -origin.z / dir.z : camera.getFarClip();
+        const Vec3f hit = ray.calcPosition(t);
+        mQuad[i] = Vec2f(hit.x, hit.y);
+    }
+
+    mSpans.clear();
+    mMin = HexCoord(mapSize.x, mapSize.y);
+    mMax = HexCoord(-1, -1);
+    mVisibleCount = 0;
+
+    //  Hexes are two units across their corners and one row spacing high
+    const Vec2f spacing = grid.getSpacing();
+    float left = mQuad[0].x, right = mQuad[0].x;
+    for (int i=1; i < 4; ++i) {
+        left = std::min(left, mQuad[i].x);
+        right = std::max(right, mQuad[i].x);
+    }
+    mFirstColumn = std::max(int(ceil((left - 1.0f) / spacing.x)), 0);
+    const int lastColumn = std::min(int(floor((right + 1.0f) / spacing.x)), mapSize.x-1);
+
+    for (int x=mFirstColumn; x <= lastColumn; ++x) {
+        HexSpan span;
+        float bottom, top;
+        if (quadRange(x * spacing.x - 1.0f, x * spacing.x + 1.0f, bottom, top)) {
+            //  odd columns sit half a row higher
+            const float offset = 0.5f * (x & 1);
+            span.first = std::max(int(ceil(bottom / spacing.y - 0.5f - offset)), 0);
+            span.last = std::min(int(floor(top / spacing.y + 0.5f - offset)), mapSize.y-1);
+        }
+        mSpans.push_back(span);
+
+        if (!span.isEmpty()) {
+            mMin = HexCoord(std::min(mMin.x, x), std::min(mMin.y, span.first));
+            mMax = HexCoord(std::max(mMax.x, x), std::max(mMax.y, span.last));
+            mVisibleCount += span.size();
+        }
+    }
+}
+
+//  Vertical extent of the quad between two x positions, false if it doesn't reach them
+bool HexCuller::quadRange(float left, float right, float& bottom, float& top) const
+{
+    bottom = FLT_MAX;
+    top = -FLT_MAX;
+    for (int i=0; i < 4; ++i) {
+        const Vec2f& a = mQuad[i];
+        const Vec2f& b = mQuad[(i+1) % 4];
+        if (a.x >= left && a.x <= right) {
+            bottom = std::min(bottom, a.y);
+            top = std::max(top, a.y);
+        }
+
+        //  where the edge crosses either side
+        const float sides[2] = { left, right };
+        for (int s=0; s < 2; ++s) {
+            if ((a.x - sides[s]) * (b.x - sides[s]) < 0) {
+                const float y = a.y + (b.y - a.y) * (sides[s] - a.x) / (b.x - a.x);
+                bottom = std::min(bottom, y);
+                top = std::max(top, y);
+            }
+        }
+    }
+    return bottom <= top;
+}
+
+HexSpan HexCuller::span(int column) const
+{
+    if (column < mFirstColumn || column > lastColumn()) {
+        return HexSpan();
+    }
+    return mSpans[column - mFirstColumn];
+}
+
+bool HexCuller::isVisible(const HexCoord& pos) const
+{
+    const HexSpan rows = span(pos.x);
+    return pos.y >= rows.first && pos.y <= rows.last;
+}
+
+bool HexCuller::intersects(const HexCoord& min, const HexCoord& max) const
+{
+    const int left = std::max(min.x, mFirstColumn);
+    const int right = std::min(max.x, lastColumn());
+    for (int x=left; x <= right; ++x) {
+        const HexSpan& rows = mSpans[x - mFirstColumn];
+        if (rows.first <= max.y && rows.last >= min.y) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,161 @@
+#include "WarGame.h"
+
+#include <cmath>
+
+//  SSE2 kernels are only used where the scalar HexGrid conversions also 
+//  compile to SSE arithmetic, otherwise x87 intermediate precision could make 
+//  the results differ.  AVX is not available to our compilers, SSE2 it is.
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define HEXGRID_SSE2 1
+#include <emmintrin.h>
+#endif
+
+using namespace ci;
+using namespace netphy;
+
+#ifdef HEXGRID_SSE2
+
+//  floor() of two doubles as ints in the low two lanes
+static inline __m128i floorToInt(__m128d v)
+{
+    __m128i t = _mm_cvttpd_epi32(v);
+    //  truncation rounds negative values up, step those back by one
+    __m128d above = _mm_cmpgt_pd(_mm_cvtepi32_pd(t), v);
+    __m128i fix = _mm_shuffle_epi32(_mm_castpd_si128(above), _MM_SHUFFLE(3, 3, 2, 0));
+    return _mm_add_epi32(t, fix);
+}
+
+//  Combine the low two int lanes of a and b into one register
+static inline __m128i joinLow(__m128i a, __m128i b)
+{
+    return _mm_unpacklo_epi64(a, b);
+}
+
+//  Double compare masks of two halves packed into four int lanes
+static inline __m128i joinMask(__m128d a, __m128d b)
+{
+    return joinLow(_mm_shuffle_epi32(_mm_castpd_si128(a), _MM_SHUFFLE(3, 3, 2, 0)),
+                   _mm_shuffle_epi32(_mm_castpd_si128(b), _MM_SHUFFLE(3, 3, 2, 0)));
+}
+
+static inline __m128d absd(__m128d v)
+{
+    return _mm_andnot_pd(_mm_set1_pd(-0.0), v);
+}
+
+#endif
+
+//  Batch version of WorldToHex, results are identical to converting one point at a time
+void HexGrid::WorldToHex(const Vec3f* worldPos, HexCoord* hexPos, size_t count)
+{
+    size_t i = 0;
+
+#ifdef HEXGRID_SSE2
+    const __m128d xspacing = _mm_set1_pd(mXSpacing);
+    const __m128d yspacing = _mm_set1_pd(mYSpacing);
+    const __m128d half = _mm_set1_pd(0.5);
+    const __m128d minusHalf = _mm_set1_pd(-0.5);
+    const __m128i one = _mm_set1_epi32(1);
+
+    for (; i + 4 <= count; i += 4) {
+        const Vec3f* p = worldPos + i;
+
+        //  Two doubles per register, so each step is done on a low and high pair
+        __m128d x0 = _mm_div_pd(_mm_set_pd(p[1].x, p[0].x), xspacing);
+        __m128d x1 = _mm_div_pd(_mm_set_pd(p[3].x, p[2].x), xspacing);
+        __m128d y0 = _mm_div_pd(_mm_set_pd(p[1].y, p[0].y), yspacing);
+        __m128d y1 = _mm_div_pd(_mm_set_pd(p[3].y, p[2].y), yspacing);
+
+        __m128d z0 = _mm_sub_pd(_mm_mul_pd(minusHalf, x0), y0);
+        __m128d z1 = _mm_sub_pd(_mm_mul_pd(minusHalf, x1), y1);
+        y0 = _mm_sub_pd(y0, _mm_mul_pd(half, x0));
+        y1 = _mm_sub_pd(y1, _mm_mul_pd(half, x1));
+
+        __m128i ix = joinLow(floorToInt(_mm_add_pd(x0, half)), floorToInt(_mm_add_pd(x1, half)));
+        __m128i iy = joinLow(floorToInt(_mm_add_pd(y0, half)), floorToInt(_mm_add_pd(y1, half)));
+        __m128i iz = joinLow(floorToInt(_mm_add_pd(z0, half)), floorToInt(_mm_add_pd(z1, half)));
+        __m128i s = _mm_add_epi32(_mm_add_epi32(ix, iy), iz);
+
+        //  Correct the coordinate furthest from its rounded value, subtracting 
+        //  s is a no-op where s is already 0
+        __m128i ixHi = _mm_shuffle_epi32(ix, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128i iyHi = _mm_shuffle_epi32(iy, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128i izHi = _mm_shuffle_epi32(iz, _MM_SHUFFLE(1, 0, 3, 2));
+        __m128d dx0 = absd(_mm_sub_pd(_mm_cvtepi32_pd(ix), x0));
+        __m128d dx1 = absd(_mm_sub_pd(_mm_cvtepi32_pd(ixHi), x1));
+        __m128d dy0 = absd(_mm_sub_pd(_mm_cvtepi32_pd(iy), y0));
+        __m128d dy1 = absd(_mm_sub_pd(_mm_cvtepi32_pd(iyHi), y1));
+        __m128d dz0 = absd(_mm_sub_pd(_mm_cvtepi32_pd(iz), z0));
+        __m128d dz1 = absd(_mm_sub_pd(_mm_cvtepi32_pd(izHi), z1));
+
+        __m128i fixX = joinMask(_mm_and_pd(_mm_cmpge_pd(dx0, dy0), _mm_cmpge_pd(dx0, dz0)),
+                                _mm_and_pd(_mm_cmpge_pd(dx1, dy1), _mm_cmpge_pd(dx1, dz1)));
+        __m128i fixY = joinMask(_mm_and_pd(_mm_cmpge_pd(dy0, dx0), _mm_cmpge_pd(dy0, dz0)),
+                                _mm_and_pd(_mm_cmpge_pd(dy1, dx1), _mm_cmpge_pd(dy1, dz1)));
+        fixY = _mm_andnot_si128(fixX, fixY);
+        __m128i fixZ = _mm_andnot_si128(_mm_or_si128(fixX, fixY), _mm_set1_epi32(-1));
+
+        ix = _mm_sub_epi32(ix, _mm_and_si128(s, fixX));
+        iy = _mm_sub_epi32(iy, _mm_and_si128(s, fixY));
+        iz = _mm_sub_epi32(iz, _mm_and_si128(s, fixZ));
+
+        //  iy = (d < 0 ? d - 1 + ((ix+1) & 1) : d + 1 - (ix & 1)) / 2, with d = iy - iz
+        __m128i d = _mm_sub_epi32(iy, iz);
+        __m128i negative = _mm_cmplt_epi32(d, _mm_setzero_si128());
+        __m128i below = _mm_add_epi32(_mm_sub_epi32(d, one), _mm_and_si128(_mm_add_epi32(ix, one), one));
+        __m128i above = _mm_sub_epi32(_mm_add_epi32(d, one), _mm_and_si128(ix, one));
+        __m128i n = _mm_or_si128(_mm_and_si128(negative, below), _mm_andnot_si128(negative, above));
+        //  signed division by 2, rounding toward zero
+        iy = _mm_srai_epi32(_mm_add_epi32(n, _mm_srli_epi32(n, 31)), 1);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&hexPos[i]), _mm_unpacklo_epi32(ix, iy));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(&hexPos[i+2]), _mm_unpackhi_epi32(ix, iy));
+    }
+#endif
+
+    for (; i < count; ++i) {
+        hexPos[i] = WorldToHex(worldPos[i]);
+    }
+}
+
+//  Batch version of HexToWorld, results are identical to converting one hex at a time
+void HexGrid::HexToWorld(const HexCoord* hexPos, Vec3f* worldPos, size_t count, bool scale)
+{
+    size_t i = 0;
+
+#ifdef HEXGRID_SSE2
+    const __m128 xscale = _mm_set1_ps(float(scale ? mXSpacing : 1.0f));
+    const __m128 yscale = _mm_set1_ps(float(scale ? mYSpacing : 1.0f));
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 minusHalf = _mm_set1_ps(-0.5f);
+    const __m128i one = _mm_set1_epi32(1);
+
+    float xs[4];
+    float ys[4];
+    for (; i + 4 <= count; i += 4) {
+        //  De-interleave four (x, y) pairs
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&hexPos[i]));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&hexPos[i+2]));
+        a = _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0));
+        b = _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i hx = _mm_unpacklo_epi64(a, b);
+        __m128i hy = _mm_unpackhi_epi64(a, b);
+
+        __m128 fx = _mm_cvtepi32_ps(hx);
+        __m128 x = _mm_mul_ps(fx, xscale);
+        //  odd columns use the even column to their left
+        __m128 yoffset = _mm_mul_ps(minusHalf, _mm_cvtepi32_ps(_mm_sub_epi32(hx, _mm_and_si128(hx, one))));
+        __m128 y = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_cvtepi32_ps(hy), _mm_mul_ps(half, fx)), yoffset), yscale);
+
+        _mm_storeu_ps(xs, x);
+        _mm_storeu_ps(ys, y);
+        for (int j=0; j < 4; ++j) {
+            worldPos[i+j] = Vec3f(xs[j], ys[j], 0);
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        worldPos[i] = HexToWorld(hexPos[i], scale);
+    }
+}
@@ -0,0 +1,558 @@
+#include "HexLabels.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+using namespace netphy;
+using std::vector;
+
+//  Cells per tile below which a worker thread costs more than it saves
+static const int MinTileCells = 64 * 1024;
+
+static void addToRegion(int& size, HexBounds& bounds, const HexCoord& pos)
+{
+    if (size++ == 0) {
+        bounds.min = bounds.max = pos;
+    }
+    else {
+        bounds.min.x = std::min(bounds.min.x, pos.x);
+        bounds.min.y = std::min(bounds.min.y, pos.y);
+        bounds.max.x = std::max(bounds.max.x, pos.x);
+        bounds.max.y = std::max(bounds.max.y, pos.y);
+    }
+}
+
+static void mergeRegion(int& size, HexBounds& bounds, int otherSize, const HexBounds& other)
+{
+    if (size == 0) {
+        bounds = other;
+    }
+    else {
+        bounds.min.x = std::min(bounds.min.x, other.min.x);
+        bounds.min.y = std::min(bounds.min.y, other.min.y);
+        bounds.max.x = std::max(bounds.max.x, other.max.x);
+        bounds.max.y = std::max(bounds.max.y, other.max.y);
+    }
+    size += otherSize;
+}
+
+HexLabeller::HexLabeller(int threads) : mThreads(threads)
+{
+}
+
+void HexLabeller::label(const HexMap& map, HexLabels& result)
+{
+    const int cells = map.cellCount();
+    const int threads = std::min(mThreads > 0 ? mThreads : int(boost::thread::hardware_concurrency()), 
+                                 cells / MinTileCells);
+    if (threads > 1) {
+        labelTiled(map, result, threads);
+        return;
+    }
+
+    mParent.resize(cells);
+
+    //  Union pass, each land cell joins the sets of its lower index neighbours
+    mTiles.resize(1);
+    Tile& all = mTiles[0];
+    all.begin = 0;
+    all.end = cells;
+    all.firstRow = 0;
+    all.lastRow = map.isChunked() ? 0 : map.getSize().y;
+    uniteTile(map, all, result);
+
+    //  Label pass, roots come before the rest of their set in index order
+    result.labels.assign(cells, -1);
+    result.sizes.clear();
+    result.bounds.clear();
+    for (int i=0; i < cells; ++i) {
+        if (!map.isLand(i)) {
+            continue;
+        }
+
+        const int root = find(i);
+        int label;
+        if (root == i) {
+            label = result.regionCount();
+            result.sizes.push_back(0);
+            result.bounds.push_back(HexBounds());
+        }
+        else {
+            label = result.labels[root];
+        }
+        result.labels[i] = label;
+        addToRegion(result.sizes[label], result.bounds[label], map.position(i));
+    }
+}
+
+void HexLabeller::labelTiled(const HexMap& map, HexLabels& result, int threads)
+{
+    const int cells = map.cellCount();
+    mParent.resize(cells);
+    mRoots.resize(cells);
+
+    //  Split the index space on row or chunk boundaries
+    mTiles.resize(threads);
+    const int width = map.getSize().x, rows = map.getSize().y;
+    const int chunks = cells / HexMap::CHUNK_CELLS;
+    for (int t=0; t < threads; ++t) {
+        Tile& tile = mTiles[t];
+        if (map.isChunked()) {
+            tile.begin = chunks * t / threads * HexMap::CHUNK_CELLS;
+            tile.end = chunks * (t+1) / threads * HexMap::CHUNK_CELLS;
+        }
+        else {
+            tile.firstRow = rows * t / threads;
+            tile.lastRow = rows * (t+1) / threads;
+            tile.begin = tile.firstRow * width;
+            tile.end = tile.lastRow * width;
+        }
+    }
+
+    //  Union within tiles, then across their seams
+    runTiles(&HexLabeller::uniteTile, map, result);
+    for (vector<Tile>::iterator tile = mTiles.begin(); tile != mTiles.end(); ++tile) {
+        for (size_t j=0; j < tile->seams.size(); ++j) {
+            unite(tile->seams[j].first, tile->seams[j].second);
+        }
+    }
+
+    //  Number the roots in index order, a tile's roots follow every earlier tile's
+    runTiles(&HexLabeller::findRoots, map, result);
+    int regions = 0;
+    for (vector<Tile>::iterator tile = mTiles.begin(); tile != mTiles.end(); ++tile) {
+        tile->base = regions;
+        regions += tile->roots;
+    }
+
+    result.labels.resize(cells);
+    result.sizes.assign(regions, 0);
+    result.bounds.assign(regions, HexBounds());
+    runTiles(&HexLabeller::labelRoots, map, result);
+    runTiles(&HexLabeller::labelCells, map, result);
+
+    //  Fold in what tiles gathered for regions rooted in earlier tiles
+    for (vector<Tile>::iterator tile = mTiles.begin(); tile != mTiles.end(); ++tile) {
+        for (vector<ForeignRegion>::iterator it = tile->foreign.begin(); it != tile->foreign.end(); ++it) {
+            mergeRegion(result.sizes[it->label], result.bounds[it->label], it->size, it->bounds);
+        }
+    }
+}
+
+//  Run a stage on every tile, one worker thread per tile
+void HexLabeller::runTiles(TileStage stage, const HexMap& map, HexLabels& result)
+{
+    boost::thread_group workers;
+    for (size_t t=1; t < mTiles.size(); ++t) {
+        workers.create_thread(boost::bind(stage, this, boost::cref(map), boost::ref(mTiles[t]), boost::ref(result)));
+    }
+    (this->*stage)(map, mTiles[0], result);
+    workers.join_all();
+}
+
+//  Union the tile's land cells with their lower index neighbours.  Unions 
+//  with cells in earlier tiles are left for later, so workers only ever 
+//  touch their own tile's sets.
+void HexLabeller::uniteTile(const HexMap& map, Tile& tile, HexLabels&)
+{
+    tile.seams.clear();
+
+    if (map.isChunked()) {
+        //  neighbours across chunk edges can be anywhere in the index space
+        int ring[HEX_DIRECTIONS];
+        for (int i=tile.begin; i < tile.end; ++i) {
+            if (!map.isLand(i)) {
+                continue;
+            }
+
+            mParent[i] = i;
+            const int owner = map.getOwner(i);
+            map.adjacent(i, ring);
+            for (int d=0; d < HEX_DIRECTIONS; ++d) {
+                const int adj = ring[d];
+                if (adj >= 0 && adj < i && map.isLand(adj) && map.getOwner(adj) == owner) {
+                    if (adj >= tile.begin) {
+                        unite(i, adj);
+                    }
+                    else {
+                        tile.seams.push_back(std::make_pair(i, adj));
+                    }
+                }
+            }
+        }
+        return;
+    }
+
+    const int width = map.getSize().x;
+    for (int y=tile.firstRow, i=tile.begin; y < tile.lastRow; ++y) {
+        for (int x=0; x < width; ++x, ++i) {
+            if (!map.isLand(i)) {
+                continue;
+            }
+
+            mParent[i] = i;
+            const int owner = map.getOwner(i);
+            const int* offsets = map.neighbourOffsets(x, y);
+            for (int d=0; d < HEX_DIRECTIONS; ++d) {
+                const int adj = i + offsets[d];
+                if (offsets[d] < 0 && map.isLand(adj) && map.getOwner(adj) == owner) {
+                    if (adj >= tile.begin) {
+                        unite(i, adj);
+                    }
+                    else {
+                        tile.seams.push_back(std::make_pair(i, adj));
+                    }
+                }
+            }
+        }
+    }
+}
+
+//  Record each land cell's root without compressing paths, which may cross 
+//  into tiles other workers are reading
+void HexLabeller::findRoots(const HexMap& map, Tile& tile, HexLabels&)
+{
+    tile.roots = 0;
+    for (int i=tile.begin; i < tile.end; ++i) {
+        if (map.isLand(i)) {
+            mRoots[i] = findRoot(i);
+            if (mRoots[i] == i) {
+                ++tile.roots;
+            }
+        }
+    }
+}
+
+void HexLabeller::labelRoots(const HexMap& map, Tile& tile, HexLabels& result)
+{
+    int label = tile.base;
+    for (int i=tile.begin; i < tile.end; ++i) {
+        if (map.isLand(i) && mRoots[i] == i) {
+            result.labels[i] = label++;
+        }
+    }
+}
+
+//  Label the rest of the tile from its roots, every root is labelled by now.
+//  Roots' labels are only read here, workers of later tiles read them too.
+void HexLabeller::labelCells(const HexMap& map, Tile& tile, HexLabels& result)
+{
+    tile.foreign.clear();
+    tile.foreignSlots.clear();
+    int lastSlot = -1;
+
+    for (int i=tile.begin; i < tile.end; ++i) {
+        if (!map.isLand(i)) {
+            result.labels[i] = -1;
+            continue;
+        }
+
+        const int root = mRoots[i];
+        const int label = root == i ? result.labels[i] : (result.labels[i] = result.labels[root]);
+        const HexCoord pos = map.position(i);
+        if (label >= tile.base && label < tile.base + tile.roots) {
+            addToRegion(result.sizes[label], result.bounds[label], pos);
+            continue;
+        }
+
+        //  regions rooted in an earlier tile are gathered separately, cells of 
+        //  one region mostly come in runs so check the last one first
+        if (lastSlot < 0 || tile.foreign[lastSlot].label != label) {
+            std::map<int, int>::iterator it = tile.foreignSlots.find(label);
+            if (it != tile.foreignSlots.end()) {
+                lastSlot = it->second;
+            }
+            else {
+                lastSlot = int(tile.foreign.size());
+                tile.foreignSlots[label] = lastSlot;
+                ForeignRegion region;
+                region.label = label;
+                region.size = 0;
+                tile.foreign.push_back(region);
+            }
+        }
+        addToRegion(tile.foreign[lastSlot].size, tile.foreign[lastSlot].bounds, pos);
+    }
+}
+
+//  Find with path halving
+int HexLabeller::find(int cell)
+{
+    while (mParent[cell] != cell) {
+        mParent[cell] = mParent[mParent[cell]];
+        cell = mParent[cell];
+    }
+    return cell;
+}
+
+int HexLabeller::findRoot(int cell) const
+{
+    while (mParent[cell] != cell) {
+        cell = mParent[cell];
+    }
+    return cell;
+}
+
+//  Link the higher root under the lower, so a set's root is its lowest index
+void HexLabeller::unite(int a, int b)
+{
+    a = find(a);
+    b = find(b);
+    if (a < b) {
+        mParent[b] = a;
+    }
+    else if (b < a) {
+        mParent[a] = b;
+    }
+}
+
+HexRegionTracker::HexRegionTracker(const HexMap& map)
+    : mMap(map), mVisitEpoch(0)
+{
+}
+
+void HexRegionTracker::reset()
+{
+    mLabeller.label(mMap, mLabels);
+    mFreeLabels.clear();
+    notify(HexRegionEvent::RESET, -1);
+}
+
+//  A chunked map allocated storage, the new cells are all sea
+void HexRegionTracker::cellsAdded()
+{
+    mLabels.labels.resize(mMap.cellCount(), -1);
+}
+
+void HexRegionTracker::cellChanged(int cell)
+{
+    const int label = mLabels.labels[cell];
+    if (label >= 0) {
+        removeCell(cell, label);
+    }
+    if (mMap.isLand(cell)) {
+        addCell(cell);
+    }
+}
+
+void HexRegionTracker::subscribe(HexRegionCallbackPtr callback)
+{
+    mCallbacks.push_back(callback);
+}
+
+void HexRegionTracker::unsubscribe(HexRegionCallbackPtr callback)
+{
+    mCallbacks.erase(std::remove(mCallbacks.begin(), mCallbacks.end(), callback), mCallbacks.end());
+}
+
+//  Join the cell to its neighbouring same-owner regions, merging them into the largest
+void HexRegionTracker::addCell(int cell)
+{
+    const int owner = mMap.getOwner(cell);
+
+    //  distinct neighbouring regions, and a cell in each
+    int joined[6];
+    int joinedCell[6];
+    int joinCount = 0;
+    int largest = -1;
+
+    int neighbours[6];
+    const int count = mMap.neighbours(cell, neighbours);
+    for (int n=0; n < count; ++n) {
+        const int label = mLabels.labels[neighbours[n]];
+        if (label < 0 || mMap.getOwner(neighbours[n]) != owner ||
+            std::find(joined, joined + joinCount, label) != joined + joinCount) {
+            continue;
+        }
+        joined[joinCount] = label;
+        joinedCell[joinCount++] = neighbours[n];
+        if (largest < 0 || mLabels.sizes[label] > mLabels.sizes[largest]) {
+            largest = label;
+        }
+    }
+
+    const HexCoord pos = mMap.position(cell);
+    const bool created = largest < 0;
+    if (created) {
+        largest = newLabel();
+        mLabels.bounds[largest].min = mLabels.bounds[largest].max = pos;
+    }
+
+    HexBounds& bounds = mLabels.bounds[largest];
+    for (int j=0; j < joinCount; ++j) {
+        const int label = joined[j];
+        if (label == largest) {
+            continue;
+        }
+
+        //  relabel the smaller region, its bounds are already known
+        HexBounds unused;
+        flood(joinedCell[j], label, largest, unused, beginVisit());
+        mLabels.sizes[largest] += mLabels.sizes[label];
+        bounds.min.x = std::min(bounds.min.x, mLabels.bounds[label].min.x);
+        bounds.min.y = std::min(bounds.min.y, mLabels.bounds[label].min.y);
+        bounds.max.x = std::max(bounds.max.x, mLabels.bounds[label].max.x);
+        bounds.max.y = std::max(bounds.max.y, mLabels.bounds[label].max.y);
+        freeLabel(label);
+        notify(HexRegionEvent::MERGED, label, largest);
+    }
+
+    mLabels.labels[cell] = largest;
+    ++mLabels.sizes[largest];
+    bounds.min.x = std::min(bounds.min.x, pos.x);
+    bounds.min.y = std::min(bounds.min.y, pos.y);
+    bounds.max.x = std::max(bounds.max.x, pos.x);
+    bounds.max.y = std::max(bounds.max.y, pos.y);
+
+    //  as with a split, a new region is announced once it holds its cell
+    notify(created ? HexRegionEvent::CREATED : HexRegionEvent::CHANGED, largest);
+}
+
+//  Take the cell out of its region, which may split it into several
+void HexRegionTracker::removeCell(int cell, int label)
+{
+    mLabels.labels[cell] = -1;
+    if (--mLabels.sizes[label] == 0) {
+        freeLabel(label);
+        notify(HexRegionEvent::REMOVED, label);
+        return;
+    }
+
+    //  Neighbours still in the region, in direction order around the cell
+    int ring[HEX_DIRECTIONS];
+    mMap.adjacent(cell, ring);
+
+    int remaining[HEX_DIRECTIONS];
+    int remainCount = 0;
+    int runs = 0;
+    for (int d=0; d < HEX_DIRECTIONS; ++d) {
+        const bool inRegion = ring[d] >= 0 && mLabels.labels[ring[d]] == label;
+        if (inRegion) {
+            remaining[remainCount++] = ring[d];
+
+            //  count runs of consecutive ring neighbours in the region
+            const int prev = ring[(d + HEX_DIRECTIONS - 1) % HEX_DIRECTIONS];
+            if (prev < 0 || mLabels.labels[prev] != label) {
+                ++runs;
+            }
+        }
+    }
+
+    //  Neighbours forming one unbroken run around the cell stay connected 
+    //  through each other, so the region can't split.  It only needs a 
+    //  re-flood if the cell was on the edge of its bounds.
+    const HexCoord pos = mMap.position(cell);
+    const HexBounds& old = mLabels.bounds[label];
+    const bool onEdge = pos.x == old.min.x || pos.x == old.max.x || pos.y == old.min.y || pos.y == old.max.y;
+    if (runs <= 1 && !onEdge) {
+        notify(HexRegionEvent::CHANGED, label);
+        return;
+    }
+
+    //  Re-flood the region from the first remaining neighbour, any neighbour 
+    //  it does not reach starts a new region
+    const uint32_t epoch = beginVisit();
+    HexBounds bounds;
+    mLabels.sizes[label] = flood(remaining[0], label, label, bounds, epoch);
+    mLabels.bounds[label] = bounds;
+
+    for (int r=1; r < remainCount; ++r) {
+        if (mVisited[remaining[r]] == epoch) {
+            continue;
+        }
+
+        const int split = newLabel();
+        mLabels.sizes[split] = flood(remaining[r], label, split, mLabels.bounds[split], epoch);
+        notify(HexRegionEvent::CREATED, split);
+    }
+
+    notify(HexRegionEvent::CHANGED, label);
+}
+
+int HexRegionTracker::newLabel()
+{
+    int label;
+    if (!mFreeLabels.empty()) {
+        label = mFreeLabels.back();
+        mFreeLabels.pop_back();
+    }
+    else {
+        label = mLabels.regionCount();
+        mLabels.sizes.push_back(0);
+        mLabels.bounds.push_back(HexBounds());
+    }
+    return label;
+}
+
+void HexRegionTracker::freeLabel(int label)
+{
+    mLabels.sizes[label] = 0;
+    mLabels.bounds[label] = HexBounds();
+    mFreeLabels.push_back(label);
+}
+
+//  Visit the cells labelled from that are connected to start, relabelling them 
+//  to.  Returns the number of cells visited and their bounds.
+int HexRegionTracker::flood(int start, int from, int to, HexBounds& bounds, uint32_t epoch)
+{
+    mStack.clear();
+    mStack.push_back(start);
+    mVisited[start] = epoch;
+    bounds.min = bounds.max = mMap.position(start);
+
+    int visited = 0;
+    int neighbours[6];
+    while (!mStack.empty()) {
+        const int cur = mStack.back();
+        mStack.pop_back();
+
+        mLabels.labels[cur] = to;
+        ++visited;
+
+        const HexCoord pos = mMap.position(cur);
+        bounds.min.x = std::min(bounds.min.x, pos.x);
+        bounds.min.y = std::min(bounds.min.y, pos.y);
+        bounds.max.x = std::max(bounds.max.x, pos.x);
+        bounds.max.y = std::max(bounds.max.y, pos.y);
+
+        const int count = mMap.neighbours(cur, neighbours);
+        for (int n=0; n < count; ++n) {
+            const int next = neighbours[n];
+            if (mLabels.labels[next] == from && mVisited[next] != epoch) {
+                mVisited[next] = epoch;
+                mStack.push_back(next);
+            }
+        }
+    }
+
+    return visited;
+}
+
+uint32_t HexRegionTracker::beginVisit()
+{
+    if (mVisited.size() != size_t(mMap.cellCount())) {
+        mVisited.assign(mMap.cellCount(), 0);
+        mVisitEpoch = 0;
+    }
+
+    if (++mVisitEpoch == 0) {
+        std::fill(mVisited.begin(), mVisited.end(), 0);
+        mVisitEpoch = 1;
+    }
+
+    return mVisitEpoch;
+}
+
+void HexRegionTracker::notify(HexRegionEvent::Type type, int label, int other)
+{
+    HexRegionEvent event;
+    event.type = type;
+    event.label = label;
+    event.other = other;
+
+    for (vector<HexRegionCallbackPtr>::iterator it = mCallbacks.begin(); it != mCallbacks.end(); ++it) {
+        (**it)(event);
+    }
+}
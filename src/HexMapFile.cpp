@@ -0,0 +1,262 @@
+#include "HexMapFile.h"
+#include "WarGame.h"
+
+#include <cstring>
+#include <fstream>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace ci;
+using namespace netphy;
+using std::string;
+using std::vector;
+
+static const char HexMapMagic[4] = { 'N', 'P', 'H', 'X' };
+
+MappedFile::MappedFile() : mData(0), mSize(0)
+{
+#if defined(_WIN32)
+    mFile = INVALID_HANDLE_VALUE;
+    mMapping = 0;
+#else
+    mFile = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+bool MappedFile::open(const string& path)
+{
+    close();
+
+#if defined(_WIN32)
+    mFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, 0);
+    if (mFile == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(mFile, &size) || size.QuadPart == 0 || size.HighPart != 0) {
+        close();
+        return false;
+    }
+    mSize = size_t(size.LowPart);
+
+    mMapping = CreateFileMappingA(mFile, 0, PAGE_WRITECOPY, 0, 0, 0);
+    if (mMapping) {
+        mData = static_cast<uint8_t*>(MapViewOfFile(mMapping, FILE_MAP_COPY, 0, 0, 0));
+    }
+#else
+    mFile = ::open(path.c_str(), O_RDONLY);
+    if (mFile < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(mFile, &st) != 0 || st.st_size == 0) {
+        close();
+        return false;
+    }
+    mSize = size_t(st.st_size);
+
+    void* data = mmap(0, mSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, mFile, 0);
+    mData = data == MAP_FAILED ? 0 : static_cast<uint8_t*>(data);
+#endif
+
+    if (!mData) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedFile::close()
+{
+#if defined(_WIN32)
+    if (mData) {
+        UnmapViewOfFile(mData);
+    }
+    if (mMapping) {
+        CloseHandle(mMapping);
+        mMapping = 0;
+    }
+    if (mFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(mFile);
+        mFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mData) {
+        munmap(mData, mSize);
+    }
+    if (mFile >= 0) {
+        ::close(mFile);
+        mFile = -1;
+    }
+#endif
+    mData = 0;
+    mSize = 0;
+}
+
+static uint32_t alignSection(uint32_t offset)
+{
+    return (offset + HEXMAP_FILE_ALIGN-1) & ~uint32_t(HEXMAP_FILE_ALIGN-1);
+}
+
+//  Check a section lies inside the file, sizes are worked out in 64 bits so 
+//  a crafted header can't wrap them
+static bool inFile(uint32_t offset, uint64_t bytes, size_t fileSize)
+{
+    return offset % HEXMAP_FILE_ALIGN == 0 && offset <= fileSize && bytes <= uint64_t(fileSize - offset);
+}
+
+bool HexMap::load(const string& path)
+{
+    boost::shared_ptr<MappedFile> file(new MappedFile());
+    if (!file->open(path) || file->size() < sizeof(HexMapFileHeader)) {
+        return false;
+    }
+
+    HexMapFileHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, HexMapMagic, 4) != 0 || header.version != HEXMAP_FILE_VERSION ||
+        header.width <= 0 || header.height <= 0 || 
+        header.width > HEXMAP_FILE_MAX_SIDE || header.height > HEXMAP_FILE_MAX_SIDE) {
+        return false;
+    }
+
+    //  Validate the layout before touching the map
+    const bool chunked = (header.flags & HEXMAP_FILE_CHUNKED) != 0;
+    const bool colors = (header.flags & HEXMAP_FILE_COLORS) != 0;
+    const Vec2i chunkCount((header.width + CHUNK_SIZE-1) / CHUNK_SIZE, (header.height + CHUNK_SIZE-1) / CHUNK_SIZE);
+    const uint64_t cells = header.cellCount;
+    const uint64_t landWords = (cells + 31) / 32;
+
+    if (chunked) {
+        if (header.chunkCount > uint64_t(chunkCount.x) * chunkCount.y ||
+            cells != (uint64_t(header.chunkCount) + 1) * CHUNK_CELLS ||
+            !inFile(header.chunksOffset, uint64_t(header.chunkCount) * sizeof(int32_t), file->size())) {
+            return false;
+        }
+    }
+    else if (cells != uint64_t(header.width) * uint64_t(header.height) || header.chunkCount != 0) {
+        return false;
+    }
+
+    if (!inFile(header.landOffset, landWords * sizeof(uint32_t), file->size()) ||
+        !inFile(header.ownersOffset, cells, file->size()) ||
+        (colors && !inFile(header.colorsOffset, cells * sizeof(Color8u), file->size()))) {
+        return false;
+    }
+
+    vector<int> slots;
+    vector<int> resident;
+    if (chunked) {
+        slots.assign(chunkCount.x * chunkCount.y, 0);
+        const int32_t* chunks = reinterpret_cast<const int32_t*>(file->data() + header.chunksOffset);
+        for (uint32_t s=0; s < header.chunkCount; ++s) {
+            if (chunks[s] < 0 || chunks[s] >= int(slots.size()) || slots[chunks[s]] != 0) {
+                return false;
+            }
+            slots[chunks[s]] = s + 1;
+            resident.push_back(chunks[s]);
+        }
+    }
+    else {
+        for (int chunk=0; chunk < chunkCount.x * chunkCount.y; ++chunk) {
+            resident.push_back(chunk);
+        }
+    }
+
+    //  Swap in the new map, the planes view the mapping
+    mSize = Vec2i(header.width, header.height);
+    mChunked = chunked;
+    mChunkCount = chunkCount;
+    mChunkSlots.swap(slots);
+    mResident.swap(resident);
+
+    //  within the side limit these all fit an int
+    mLand.view(reinterpret_cast<uint32_t*>(file->data() + header.landOffset), size_t(landWords));
+    mOwners.view(file->data() + header.ownersOffset, size_t(cells));
+    if (colors) {
+        mColors.view(reinterpret_cast<Color8u*>(file->data() + header.colorsOffset), size_t(cells));
+    }
+    else {
+        mColors.assign(size_t(cells), Color8u(Color(0.15f, 0.15f, 0.15f)));
+    }
+    mFile = file;
+
+    resetDerived();
+    return true;
+}
+
+static void writePadding(std::ofstream& out, uint32_t to)
+{
+    static const char zeros[HEXMAP_FILE_ALIGN] = { 0 };
+    out.write(zeros, to - uint32_t(out.tellp()));
+}
+
+bool HexMap::save(const string& path, bool colors)
+{
+    if (mSize.x > HEXMAP_FILE_MAX_SIDE || mSize.y > HEXMAP_FILE_MAX_SIDE) {
+        return false;
+    }
+
+    //  The file being written may be the one the planes view
+    if (mFile) {
+        mLand.detach();
+        mOwners.detach();
+        mColors.detach();
+        mFile.reset();
+    }
+
+    const uint32_t cells = cellCount();
+    const uint32_t landBytes = (cells + 31) / 32 * sizeof(uint32_t);
+
+    HexMapFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, HexMapMagic, 4);
+    header.version = HEXMAP_FILE_VERSION;
+    header.width = mSize.x;
+    header.height = mSize.y;
+    header.flags = (mChunked ? HEXMAP_FILE_CHUNKED : 0) | (colors ? HEXMAP_FILE_COLORS : 0);
+    header.cellCount = cells;
+    header.chunkCount = mChunked ? uint32_t(mResident.size()) : 0;
+
+    header.chunksOffset = alignSection(sizeof(header));
+    header.landOffset = alignSection(header.chunksOffset + header.chunkCount * sizeof(int32_t));
+    header.ownersOffset = alignSection(header.landOffset + landBytes);
+    header.colorsOffset = colors ? alignSection(header.ownersOffset + cells) : 0;
+
+    std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    writePadding(out, header.chunksOffset);
+    for (uint32_t s=0; s < header.chunkCount; ++s) {
+        const int32_t chunk = mResident[s];
+        out.write(reinterpret_cast<const char*>(&chunk), sizeof(chunk));
+    }
+    writePadding(out, header.landOffset);
+    out.write(reinterpret_cast<const char*>(&mLand[0]), landBytes);
+    writePadding(out, header.ownersOffset);
+    out.write(reinterpret_cast<const char*>(&mOwners[0]), cells);
+    if (colors) {
+        writePadding(out, header.colorsOffset);
+        out.write(reinterpret_cast<const char*>(&mColors[0]), cells * sizeof(Color8u));
+    }
+
+    return out.good();
+}
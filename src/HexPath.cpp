@@ -0,0 +1,224 @@
+#include "HexPath.h"
+
+#include <algorithm>
+
+using namespace netphy;
+using std::vector;
+
+HexPathCosts::HexPathCosts(int land, int sea) : mSea(sea)
+{
+    setLand(land);
+}
+
+void HexPathCosts::setLand(int cost)
+{
+    std::fill(mLand, mLand + 256, cost);
+}
+
+int HexPathCosts::minimum() const
+{
+    int least = mSea;
+    for (int owner=0; owner < 256; ++owner) {
+        if (least < 0 || (mLand[owner] >= 0 && mLand[owner] < least)) {
+            least = mLand[owner];
+        }
+    }
+    return least;
+}
+
+//  Cells the search may step onto, chunked maps share one index between every
+//  cell without storage so those are never entered.  Chunk cells past the map
+//  edge are never anyone's neighbour, see HexMap::adjacent().
+static bool enterable(const HexMap& map, int index)
+{
+    if (index < 0 || !map.hasStorage(index)) {
+        return false;
+    }
+    assert(!map.isChunked() || map.isValid(map.position(index)));
+    return true;
+}
+
+HexPathfinder::HexPathfinder(const HexMap& map) : mMap(map), mCost(0), mEpoch(0)
+{
+}
+
+bool HexPathfinder::findPath(const HexCoord& from, const HexCoord& to, const HexPathCosts& costs, vector<HexCoord>& path)
+{
+    path.clear();
+    mCost = 0;
+    if (!mMap.isValid(from) || !mMap.isValid(to)) {
+        return false;
+    }
+    if (from == to) {
+        return true;
+    }
+
+    const int start = mMap.index(from);
+    const int goal = mMap.index(to);
+    if (!enterable(mMap, goal) || costs.cost(mMap, goal) < 0) {
+        return false;
+    }
+
+    const int scale = std::max(costs.minimum(), 0);
+    const uint32_t epoch = beginSearch();
+    mOpen.clear();
+
+    mStamp[start] = epoch;
+    mG[start] = 0;
+    mParent[start] = -1;
+    Node first = { scale * HexGrid::distance(from, to), 0, start };
+    mOpen.push_back(first);
+
+    int ring[HEX_DIRECTIONS];
+    while (!mOpen.empty()) {
+        std::pop_heap(mOpen.begin(), mOpen.end());
+        const Node node = mOpen.back();
+        mOpen.pop_back();
+
+        //  skip entries superseded by a cheaper route
+        if (node.g != mG[node.cell]) {
+            continue;
+        }
+
+        if (node.cell == goal) {
+            mCost = node.g;
+            for (int cell = goal; cell != start; cell = mParent[cell]) {
+                path.push_back(mMap.position(cell));
+            }
+            std::reverse(path.begin(), path.end());
+            return true;
+        }
+
+        //  the start may have no storage, so take its neighbours from its position
+        if (node.cell == start) {
+            mMap.adjacent(from, ring);
+        }
+        else {
+            mMap.adjacent(node.cell, ring);
+        }
+
+        for (int d=0; d < HEX_DIRECTIONS; ++d) {
+            const int next = ring[d];
+            if (!enterable(mMap, next)) {
+                continue;
+            }
+            const int cost = costs.cost(mMap, next);
+            if (cost < 0) {
+                continue;
+            }
+
+            const int g = node.g + cost;
+            if (mStamp[next] != epoch || g < mG[next]) {
+                mStamp[next] = epoch;
+                mG[next] = g;
+                mParent[next] = node.cell;
+
+                Node open = { g + scale * HexGrid::distance(mMap.position(next), to), g, next };
+                mOpen.push_back(open);
+                std::push_heap(mOpen.begin(), mOpen.end());
+            }
+        }
+    }
+
+    return false;
+}
+
+//  Start a new query, returns the stamp marking cells it has touched
+uint32_t HexPathfinder::beginSearch()
+{
+    const size_t cells = mMap.cellCount();
+    if (mStamp.size() != cells) {
+        mG.resize(cells);
+        mParent.resize(cells);
+        mStamp.assign(cells, 0);
+        mEpoch = 0;
+    }
+
+    if (++mEpoch == 0) {
+        std::fill(mStamp.begin(), mStamp.end(), 0);
+        mEpoch = 1;
+    }
+
+    return mEpoch;
+}
+
+HexFlowField::HexFlowField(const HexMap& map) : mMap(map)
+{
+}
+
+void HexFlowField::build(const vector<HexCoord>& targets, const HexPathCosts& costs)
+{
+    const size_t cells = mMap.cellCount();
+    mDistance.assign(cells, -1);
+    mDirection.assign(cells, -1);
+    mOpen.clear();
+
+    for (vector<HexCoord>::const_iterator it = targets.begin(); it != targets.end(); ++it) {
+        if (!mMap.isValid(*it)) {
+            continue;
+        }
+        const int target = mMap.index(*it);
+        if (enterable(mMap, target) && costs.cost(mMap, target) >= 0 && mDistance[target] != 0) {
+            mDistance[target] = 0;
+            Node node = { 0, target };
+            mOpen.push_back(node);
+        }
+    }
+    std::make_heap(mOpen.begin(), mOpen.end());
+
+    //  Dijkstra outwards from the targets.  A unit on a neighbour pays the
+    //  cost of this cell to step onto it.
+    int ring[HEX_DIRECTIONS];
+    while (!mOpen.empty()) {
+        std::pop_heap(mOpen.begin(), mOpen.end());
+        const Node node = mOpen.back();
+        mOpen.pop_back();
+
+        if (node.d != mDistance[node.cell]) {
+            continue;
+        }
+
+        const int step = node.d + costs.cost(mMap, node.cell);
+        mMap.adjacent(node.cell, ring);
+        for (int d=0; d < HEX_DIRECTIONS; ++d) {
+            const int prev = ring[d];
+            if (!enterable(mMap, prev) || costs.cost(mMap, prev) < 0) {
+                continue;
+            }
+
+            if (mDistance[prev] < 0 || step < mDistance[prev]) {
+                mDistance[prev] = step;
+                //  the neighbour in direction d steps back the opposite way
+                mDirection[prev] = int8_t((d + HEX_DIRECTIONS/2) % HEX_DIRECTIONS);
+
+                Node open = { step, prev };
+                mOpen.push_back(open);
+                std::push_heap(mOpen.begin(), mOpen.end());
+            }
+        }
+    }
+}
+
+int HexFlowField::distance(const HexCoord& pos) const
+{
+    if (!mMap.isValid(pos)) {
+        return -1;
+    }
+    const int index = mMap.index(pos);
+    return reached(index) ? mDistance[index] : -1;
+}
+
+int HexFlowField::direction(const HexCoord& pos) const
+{
+    if (!mMap.isValid(pos)) {
+        return -1;
+    }
+    const int index = mMap.index(pos);
+    return reached(index) ? mDirection[index] : -1;
+}
+
+HexCoord HexFlowField::next(const HexCoord& pos) const
+{
+    const int dir = direction(pos);
+    return dir < 0 ? pos : HexGrid::neighbour(pos, dir);
+}
@@ -0,0 +1,97 @@
+#include "HexPicking.h"
+
+#include <algorithm>
+#include <cfloat>
+
+using namespace ci;
+using namespace netphy;
+using std::vector;
+
+HexPicker::HexPicker(HexRender& render, HexGrid& grid, Mouse& mouse)
+    : mRender(render), mHexGrid(grid), mMouse(mouse), mHoveredHex(-1, -1)
+{
+}
+
+void HexPicker::update()
+{
+    mHoveredPoint = project(mMouse.getPos());
+    mHoveredHex = mHexGrid.WorldToHex(mHoveredPoint);
+}
+
+Vec3f HexPicker::project(const Vec2f& screen) const
+{
+    const Camera& camera = mRender.getCamera();
+    Ray ray = camera.generateRay(screen.x, screen.y, camera.getAspectRatio());
+    const Vec3f& origin = ray.getOrigin();
+    const Vec3f& dir = ray.getDirection();
+    const float t = dir.z < 0 ? -origin.z / dir.z : camera.getFarClip();
+    Vec3f hit = ray.calcPosition(t);
+    hit.z = 0;
+    return hit;
+}
+
+void HexPicker::pickRect(const HexMap& map, const Vec2f& corner, const Vec2f& opposite, vector<HexCoord>& cells)
+{
+    mScreen.clear();
+    mScreen.push_back(corner);
+    mScreen.push_back(Vec2f(opposite.x, corner.y));
+    mScreen.push_back(opposite);
+    mScreen.push_back(Vec2f(corner.x, opposite.y));
+    pickLasso(map, mScreen, cells);
+}
+
+void HexPicker::pickLasso(const HexMap& map, const vector<Vec2f>& points, vector<HexCoord>& cells)
+{
+    mPolygon.clear();
+    for (vector<Vec2f>::const_iterator it = points.begin(); it != points.end(); ++it) {
+        const Vec3f hit = project(*it);
+        mPolygon.push_back(Vec2f(hit.x, hit.y));
+    }
+    pickPolygon(map, cells);
+}
+
+//  Cells whose centres fall inside mPolygon, by the even-odd rule so a lasso
+//  crossing itself leaves holes
+void HexPicker::pickPolygon(const HexMap& map, vector<HexCoord>& cells)
+{
+    cells.clear();
+    const size_t corners = mPolygon.size();
+    if (corners < 3) {
+        return;
+    }
+
+    const Vec2i size = map.getSize();
+    const Vec2f spacing = mHexGrid.getSpacing();
+    float left = FLT_MAX, right = -FLT_MAX;
+    for (size_t i=0; i < corners; ++i) {
+        left = std::min(left, mPolygon[i].x);
+        right = std::max(right, mPolygon[i].x);
+    }
+    const int firstColumn = std::max(int(ceil(left / spacing.x)), 0);
+    const int lastColumn = std::min(int(floor(right / spacing.x)), size.x-1);
+
+    for (int x=firstColumn; x <= lastColumn; ++x) {
+        //  where the edges cross the column's centre line, with each edge
+        //  half open so a corner on the line is only counted once
+        const float cx = x * spacing.x;
+        mCrossings.clear();
+        for (size_t i=0; i < corners; ++i) {
+            const Vec2f& a = mPolygon[i];
+            const Vec2f& b = mPolygon[(i+1) % corners];
+            if ((a.x <= cx) != (b.x <= cx)) {
+                mCrossings.push_back(a.y + (b.y - a.y) * (cx - a.x) / (b.x - a.x));
+            }
+        }
+        std::sort(mCrossings.begin(), mCrossings.end());
+
+        //  odd columns sit half a row higher
+        const float offset = 0.5f * (x & 1);
+        for (size_t i=0; i+1 < mCrossings.size(); i += 2) {
+            const int first = std::max(int(ceil(mCrossings[i] / spacing.y - offset)), 0);
+            const int last = std::min(int(floor(mCrossings[i+1] / spacing.y - offset)), size.y-1);
+            for (int y=first; y <= last; ++y) {
+                cells.push_back(HexCoord(x, y));
+            }
+        }
+    }
+}
@@ -0,0 +1,209 @@
+#include "Log.h"
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#pragma intrinsic(_InterlockedCompareExchange, _InterlockedExchange, _InterlockedIncrement)
+#define snprintf _snprintf
+#define vsnprintf _vsnprintf
+#endif
+
+using namespace netphy;
+
+//  Volatile accesses are acquire loads and release stores under VC, GCC
+//  needs the barriers spelled out
+namespace {
+
+long compareExchange(volatile long* target, long exchange, long comparand)
+{
+#ifdef _MSC_VER
+    return _InterlockedCompareExchange(target, exchange, comparand);
+#else
+    return __sync_val_compare_and_swap(target, comparand, exchange);
+#endif
+}
+
+long exchange(volatile long* target, long value)
+{
+#ifdef _MSC_VER
+    return _InterlockedExchange(target, value);
+#else
+    return __sync_lock_test_and_set(target, value);
+#endif
+}
+
+void increment(volatile long* target)
+{
+#ifdef _MSC_VER
+    _InterlockedIncrement(target);
+#else
+    __sync_fetch_and_add(target, 1);
+#endif
+}
+
+long acquire(const volatile long* source)
+{
+    const long value = *source;
+#ifndef _MSC_VER
+    __sync_synchronize();
+#endif
+    return value;
+}
+
+void release(volatile long* target, long value)
+{
+#ifndef _MSC_VER
+    __sync_synchronize();
+#endif
+    *target = value;
+}
+
+}
+
+LogSink::LogSink(size_t capacity) : mEnqueue(0), mDequeue(0), mDropped(0), mLevel(LEVEL_INFO)
+{
+    size_t slots = 2;
+    while (slots < capacity) {
+        slots *= 2;
+    }
+    mSlots.resize(slots);
+    mMask = (unsigned long) (slots - 1);
+
+    //  slot i is free for the write at position i
+    for (size_t i=0; i < slots; ++i) {
+        mSlots[i].sequence = long(i);
+    }
+}
+
+bool LogSink::write(LogLevel level, const char* text, size_t length)
+{
+    Slot* slot;
+    long position = acquire(&mEnqueue);
+    for (;;) {
+        slot = &mSlots[(unsigned long) position & mMask];
+        const long lag = long((unsigned long) acquire(&slot->sequence) - (unsigned long) position);
+        if (lag == 0) {
+            const long claimed = compareExchange(&mEnqueue, long((unsigned long) position + 1), position);
+            if (claimed == position) {
+                break;
+            }
+            position = claimed;
+        }
+        else if (lag < 0) {
+            //  the reader hasn't freed this slot since the last time round
+            increment(&mDropped);
+            return false;
+        }
+        else {
+            //  another writer took it first
+            position = acquire(&mEnqueue);
+        }
+    }
+
+    slot->level = level;
+    slot->length = std::min(length, size_t(SlotText));
+    memcpy(slot->text, text, slot->length);
+    release(&slot->sequence, long((unsigned long) position + 1));
+    return true;
+}
+
+size_t LogSink::drain(LogTarget& target)
+{
+    size_t count = 0;
+    for (;;) {
+        Slot& slot = mSlots[mDequeue & mMask];
+        if ((unsigned long) acquire(&slot.sequence) != mDequeue + 1) {
+            break;
+        }
+        target.write(slot.level, slot.text, slot.length);
+        release(&slot.sequence, long(mDequeue + mMask + 1));
+        ++mDequeue;
+        ++count;
+    }
+
+    const long dropped = exchange(&mDropped, 0);
+    if (dropped) {
+        char text[64];
+        const int length = snprintf(text, sizeof(text), "(%ld log messages dropped)\n", dropped);
+        target.write(LEVEL_WARNING, text, size_t(std::max(length, 0)));
+    }
+    return count;
+}
+
+//  The line ends here, room for its newline is kept free
+LogLine::~LogLine()
+{
+    mText[mLength++] = '\n';
+    mSink.write(mLevel, mText, mLength);
+}
+
+void LogLine::append(const char* text, size_t length)
+{
+    length = std::min(length, sizeof(mText) - 1 - mLength);
+    memcpy(mText + mLength, text, length);
+    mLength += length;
+}
+
+void LogLine::print(const char* format, ...)
+{
+    const size_t room = sizeof(mText) - 1 - mLength;
+    va_list args;
+    va_start(args, format);
+    const int length = vsnprintf(mText + mLength, room, format, args);
+    va_end(args);
+
+    //  VC gives -1 when cut short, C99 the length it would have been
+    mLength += length < 0 || size_t(length) >= room ? room - (room > 0) : size_t(length);
+}
+
+LogLine& LogLine::operator<<(const char* text)
+{
+    append(text, strlen(text));
+    return *this;
+}
+
+LogLine& LogLine::operator<<(const std::string& text)
+{
+    append(text.data(), text.size());
+    return *this;
+}
+
+LogLine& LogLine::operator<<(char value)
+{
+    append(&value, 1);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(int value)
+{
+    print("%d", value);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(unsigned int value)
+{
+    print("%u", value);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(long value)
+{
+    print("%ld", value);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(unsigned long value)
+{
+    print("%lu", value);
+    return *this;
+}
+
+LogLine& LogLine::operator<<(double value)
+{
+    print("%g", value);
+    return *this;
+}
@@ -55,23 +55,26 @@ void Physics::setup()
 
 	// Add the shape to the body.
 	mBody->CreateFixture(&fixtureDef);
+
+    mPrevPosition = mBody->GetPosition();
+    mPrevAngle = mBody->GetAngle();
 }
 
 void Physics::update(float dt)
 {
-	float32 timeStep = 1.0f / 60.0f;
 	int32 velocityIterations = 6;
 	int32 positionIterations = 2;
 
-    mWorld->Step(timeStep, velocityIterations, positionIterations);
+    mPrevPosition = mBody->GetPosition();
+    mPrevAngle = mBody->GetAngle();
+    mWorld->Step(dt, velocityIterations, positionIterations);
     mWorld->ClearForces();
 }
 
-void Physics::draw()
+void Physics::draw(float alpha)
 {
-    b2Vec2 position = mBody->GetPosition();
-    float32 angle = mBody->GetAngle();
-    GuiConsoleOutput cout = GG.console->output();
-    cout << position.x << position.y << angle << endl;
+    b2Vec2 position = mPrevPosition + alpha * (mBody->GetPosition() - mPrevPosition);
+    float32 angle = mPrevAngle + alpha * (mBody->GetAngle() - mPrevAngle);
+    NETPHY_LOG(GG.console->log(), LEVEL_DEBUG) << position.x << " " << position.y << " " << angle;
 }
 
@@ -0,0 +1,247 @@
+#include "RenderBackend.h"
+
+#include <algorithm>
+
+//  Instanced drawing, where the GL headers have the extensions
+#if defined(GL_ARB_instanced_arrays) && defined(GL_ARB_draw_instanced)
+#define HEX_INSTANCING 1
+#else
+#define HEX_INSTANCING 0
+#endif
+
+using namespace ci;
+using namespace netphy;
+
+GlRenderBackend::GlRenderBackend() : mInstancing(-1), mMaxTextureSize(-1), mDivisors(false)
+{
+}
+
+bool GlRenderBackend::hasInstancing()
+{
+    if (mInstancing < 0) {
+        mInstancing = HEX_INSTANCING && gl::isExtensionAvailable("GL_ARB_instanced_arrays") &&
+                      gl::isExtensionAvailable("GL_ARB_draw_instanced");
+    }
+    return mInstancing != 0;
+}
+
+GLint GlRenderBackend::getMaxTextureSize()
+{
+    if (mMaxTextureSize < 0) {
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &mMaxTextureSize);
+    }
+    return mMaxTextureSize;
+}
+
+GLint GlRenderBackend::attribLocation(gl::GlslProg& shader, const char* name)
+{
+    return shader.getAttribLocation(name);
+}
+
+void GlRenderBackend::bufferData(gl::Vbo& vbo, GLenum target, size_t bytes, const void* data, GLenum usage)
+{
+    if (!vbo) {
+        vbo = gl::Vbo(target);
+    }
+    vbo.bufferData(bytes, data, usage);
+}
+
+void GlRenderBackend::bufferSubData(gl::Vbo& vbo, size_t offset, size_t bytes, const void* data)
+{
+    vbo.bufferSubData(offset, bytes, data);
+}
+
+void GlRenderBackend::createTexture(gl::Texture& texture, int width, int height, const gl::Texture::Format& format)
+{
+    texture = gl::Texture(width, height, format);
+}
+
+void GlRenderBackend::createTexture(gl::Texture& texture, const Surface& surface)
+{
+    texture = gl::Texture(surface);
+    texture.unbind();
+}
+
+void GlRenderBackend::textureSubImage(gl::Texture& texture, const Area& area, int rowLength, GLenum format, const void* data)
+{
+    texture.bind();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+    glTexSubImage2D(texture.getTarget(), 0, area.x1, area.y1, area.getWidth(), area.getHeight(), format, GL_UNSIGNED_BYTE, data);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void GlRenderBackend::setMatrices(const Matrix44f& projection, const Matrix44f& modelView)
+{
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(projection.m);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(modelView.m);
+}
+
+void GlRenderBackend::pushMatrix(const Vec2f& translate)
+{
+    glPushMatrix();
+    gl::translate(translate);
+}
+
+void GlRenderBackend::popMatrix()
+{
+    glPopMatrix();
+}
+
+void GlRenderBackend::color(const ColorA& color)
+{
+    gl::color(color);
+}
+
+void GlRenderBackend::clear(const ColorA& color)
+{
+    gl::clear(color);
+}
+
+void GlRenderBackend::bindShader(gl::GlslProg& shader)
+{
+    shader.bind();
+}
+
+void GlRenderBackend::unbindShader(gl::GlslProg& shader)
+{
+    shader.unbind();
+}
+
+void GlRenderBackend::uniform(gl::GlslProg& shader, const char* name, int value)
+{
+    shader.uniform(name, value);
+}
+
+void GlRenderBackend::uniform(gl::GlslProg& shader, const char* name, float value)
+{
+    shader.uniform(name, value);
+}
+
+void GlRenderBackend::uniform(gl::GlslProg& shader, const char* name, const Vec2f& value)
+{
+    shader.uniform(name, value);
+}
+
+void GlRenderBackend::uniform(gl::GlslProg& shader, const char* name, const ColorA& value)
+{
+    shader.uniform(name, value);
+}
+
+//  Enabled as well for fixed function drawing, shaders ignore it
+void GlRenderBackend::bindTexture(gl::Texture& texture)
+{
+    texture.enableAndBind();
+}
+
+void GlRenderBackend::unbindTexture(gl::Texture& texture)
+{
+    texture.unbind();
+    texture.disable();
+}
+
+void GlRenderBackend::vertexArray(gl::Vbo& vbo, GLint array, GLint components, GLenum type, bool normalize,
+                                  GLsizei stride, size_t offset, GLuint divisor)
+{
+    vbo.bind();
+    const GLvoid* pointer = (const GLvoid*) offset;
+    if (array == POSITION_ARRAY) {
+        glEnableClientState(GL_VERTEX_ARRAY);
+        glVertexPointer(components, type, stride, pointer);
+    }
+    else if (array == COLOR_ARRAY) {
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(components, type, stride, pointer);
+    }
+    else if (array == TEXCOORD_ARRAY) {
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(components, type, stride, pointer);
+    }
+    else {
+        glEnableVertexAttribArray(array);
+        glVertexAttribPointer(array, components, type, normalize ? GL_TRUE : GL_FALSE, stride, pointer);
+#if HEX_INSTANCING
+        if (divisor || mDivisors) {
+            glVertexAttribDivisorARB(array, divisor);
+            mDivisors = true;
+        }
+#endif
+    }
+
+    if (std::find(mEnabled.begin(), mEnabled.end(), array) == mEnabled.end()) {
+        mEnabled.push_back(array);
+    }
+}
+
+void GlRenderBackend::disableArrays()
+{
+    for (std::vector<GLint>::iterator it = mEnabled.begin(); it != mEnabled.end(); ++it) {
+        if (*it == POSITION_ARRAY) {
+            glDisableClientState(GL_VERTEX_ARRAY);
+        }
+        else if (*it == COLOR_ARRAY) {
+            glDisableClientState(GL_COLOR_ARRAY);
+        }
+        else if (*it == TEXCOORD_ARRAY) {
+            glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+        }
+        else {
+#if HEX_INSTANCING
+            if (mDivisors) {
+                glVertexAttribDivisorARB(*it, 0);
+            }
+#endif
+            glDisableVertexAttribArray(*it);
+        }
+    }
+    mEnabled.clear();
+    mDivisors = false;
+    gl::VboMesh::unbindBuffers();
+}
+
+void GlRenderBackend::drawElements(gl::Vbo& indices, GLenum mode, GLsizei count, GLenum type, GLsizei instances)
+{
+    indices.bind();
+#if HEX_INSTANCING
+    if (instances) {
+        glDrawElementsInstancedARB(mode, count, type, 0, instances);
+        return;
+    }
+#endif
+    glDrawElements(mode, count, type, 0);
+}
+
+void GlRenderBackend::drawRect(const Rectf& rect)
+{
+    gl::drawSolidRect(rect);
+}
+
+void GlRenderBackend::drawTexture(gl::Texture& texture, const Vec2f& pos)
+{
+    texture.bind();
+    gl::draw(texture, pos);
+    texture.unbind();
+}
+
+RecordingRenderBackend::RecordingRenderBackend(bool instancing, GLint maxTextureSize)
+    : mInstancing(instancing), mMaxTextureSize(maxTextureSize)
+{
+}
+
+void RecordingRenderBackend::createTexture(gl::Texture&, const Surface& surface)
+{
+    upload(surface.getHeight() * surface.getRowBytes());
+}
+
+void RecordingRenderBackend::textureSubImage(gl::Texture&, const Area& area, int, GLenum format, const void*)
+{
+    upload(area.getWidth() * area.getHeight() * (format == GL_RGBA ? 4 : 3));
+}
+
+void RecordingRenderBackend::drawElements(gl::Vbo&, GLenum, GLsizei count, GLenum, GLsizei instances)
+{
+    draw(size_t(count) * std::max(instances, 1));
+}
@@ -0,0 +1,420 @@
+#include "RenderList.h"
+
+#include <cstring>
+
+using namespace ci;
+using namespace netphy;
+
+void RenderList::clear()
+{
+    mCommands.clear();
+    mData.clear();
+    mSurfaces.clear();
+    mFormats.clear();
+}
+
+RenderList::Command& RenderList::add(CommandType type, void* object)
+{
+    mCommands.push_back(Command());
+    Command& command = mCommands.back();
+    command.type = type;
+    command.object = object;
+    command.name = 0;
+    command.data = NoData;
+    return command;
+}
+
+//  Data is kept by offset, mData moves as it grows
+size_t RenderList::copy(const void* data, size_t bytes)
+{
+    if (!data) {
+        return NoData;
+    }
+    const size_t offset = mData.size();
+    mData.resize(offset + bytes);
+    if (bytes) {
+        memcpy(&mData[offset], data, bytes);
+    }
+    return offset;
+}
+
+const void* RenderList::data(const Command& command) const
+{
+    return command.data == NoData ? 0 : &mData[0] + command.data;
+}
+
+void RenderList::submit(RenderBackend& backend) const
+{
+    for (std::vector<Command>::const_iterator it = mCommands.begin(); it != mCommands.end(); ++it) {
+        //  only the commands naming an object carry one, the rest leave it null
+        const Command& c = *it;
+
+        switch (c.type)
+        {
+        case BUFFER_DATA:
+            backend.bufferData(*static_cast<gl::Vbo*>(c.object), c.mode, c.bytes, data(c), GLenum(c.i[0]));
+            break;
+        case BUFFER_SUB_DATA:
+            backend.bufferSubData(*static_cast<gl::Vbo*>(c.object), c.offset, c.bytes, data(c));
+            break;
+        case CREATE_TEXTURE:
+            backend.createTexture(*static_cast<gl::Texture*>(c.object), c.i[0], c.i[1], mFormats[c.i[2]]);
+            break;
+        case CREATE_TEXTURE_SURFACE:
+            backend.createTexture(*static_cast<gl::Texture*>(c.object), mSurfaces[c.i[0]]);
+            break;
+        case TEXTURE_SUB_IMAGE:
+            backend.textureSubImage(*static_cast<gl::Texture*>(c.object), Area(c.i[0], c.i[1], c.i[2], c.i[3]), c.i[4], c.mode, data(c));
+            break;
+        case SET_MATRICES: {
+            //  the arena has no alignment to speak of
+            Matrix44f projection, modelView;
+            memcpy(&projection, data(c), sizeof(Matrix44f));
+            memcpy(&modelView, static_cast<const char*>(data(c)) + sizeof(Matrix44f), sizeof(Matrix44f));
+            backend.setMatrices(projection, modelView);
+            break;
+        }
+        case PUSH_MATRIX:
+            backend.pushMatrix(Vec2f(c.f[0], c.f[1]));
+            break;
+        case POP_MATRIX:
+            backend.popMatrix();
+            break;
+        case COLOR:
+            backend.color(ColorA(c.f[0], c.f[1], c.f[2], c.f[3]));
+            break;
+        case CLEAR:
+            backend.clear(ColorA(c.f[0], c.f[1], c.f[2], c.f[3]));
+            break;
+        case BIND_SHADER:
+            backend.bindShader(*static_cast<gl::GlslProg*>(c.object));
+            break;
+        case UNBIND_SHADER:
+            backend.unbindShader(*static_cast<gl::GlslProg*>(c.object));
+            break;
+        case UNIFORM_INT:
+            backend.uniform(*static_cast<gl::GlslProg*>(c.object), c.name, int(c.i[0]));
+            break;
+        case UNIFORM_FLOAT:
+            backend.uniform(*static_cast<gl::GlslProg*>(c.object), c.name, c.f[0]);
+            break;
+        case UNIFORM_VEC2:
+            backend.uniform(*static_cast<gl::GlslProg*>(c.object), c.name, Vec2f(c.f[0], c.f[1]));
+            break;
+        case UNIFORM_COLOR:
+            backend.uniform(*static_cast<gl::GlslProg*>(c.object), c.name, ColorA(c.f[0], c.f[1], c.f[2], c.f[3]));
+            break;
+        case BIND_TEXTURE:
+            backend.bindTexture(*static_cast<gl::Texture*>(c.object));
+            break;
+        case UNBIND_TEXTURE:
+            backend.unbindTexture(*static_cast<gl::Texture*>(c.object));
+            break;
+        case VERTEX_ARRAY:
+            backend.vertexArray(*static_cast<gl::Vbo*>(c.object), c.i[0], c.i[1], c.mode, c.i[2] != 0, c.i[3], c.offset, GLuint(c.i[4]));
+            break;
+        case DISABLE_ARRAYS:
+            backend.disableArrays();
+            break;
+        case DRAW_ELEMENTS:
+            backend.drawElements(*static_cast<gl::Vbo*>(c.object), c.mode, c.i[0], GLenum(c.i[1]), c.i[2]);
+            break;
+        case DRAW_RECT:
+            backend.drawRect(Rectf(c.f[0], c.f[1], c.f[2], c.f[3]));
+            break;
+        case DRAW_TEXTURE:
+            backend.drawTexture(*static_cast<gl::Texture*>(c.object), Vec2f(c.f[0], c.f[1]));
+            break;
+        }
+    }
+}
+
+RenderListBackend::RenderListBackend(RenderBackendPtr device) : mDevice(device), mList(0)
+{
+}
+
+void RenderListBackend::bufferData(gl::Vbo& vbo, GLenum target, size_t bytes, const void* data, GLenum usage)
+{
+    RenderList::Command& command = mList->add(RenderList::BUFFER_DATA, &vbo);
+    command.mode = target;
+    command.i[0] = GLint(usage);
+    command.bytes = bytes;
+    command.data = mList->copy(data, bytes);
+}
+
+void RenderListBackend::bufferSubData(gl::Vbo& vbo, size_t offset, size_t bytes, const void* data)
+{
+    RenderList::Command& command = mList->add(RenderList::BUFFER_SUB_DATA, &vbo);
+    command.offset = offset;
+    command.bytes = bytes;
+    command.data = mList->copy(data, bytes);
+}
+
+void RenderListBackend::createTexture(gl::Texture& texture, int width, int height, const gl::Texture::Format& format)
+{
+    RenderList::Command& command = mList->add(RenderList::CREATE_TEXTURE, &texture);
+    command.i[0] = width;
+    command.i[1] = height;
+    command.i[2] = GLint(mList->mFormats.size());
+    mList->mFormats.push_back(format);
+}
+
+//  Surfaces share their pixels, the rendered text is never written again
+void RenderListBackend::createTexture(gl::Texture& texture, const Surface& surface)
+{
+    RenderList::Command& command = mList->add(RenderList::CREATE_TEXTURE_SURFACE, &texture);
+    command.i[0] = GLint(mList->mSurfaces.size());
+    mList->mSurfaces.push_back(surface);
+}
+
+//  Only the area's rows are copied, packed to its width
+void RenderListBackend::textureSubImage(gl::Texture& texture, const Area& area, int rowLength, GLenum format, const void* data)
+{
+    const size_t pixel = format == GL_RGBA ? 4 : 3;
+    const size_t row = area.getWidth() * pixel;
+    RenderList::Command& command = mList->add(RenderList::TEXTURE_SUB_IMAGE, &texture);
+    command.i[0] = area.x1;
+    command.i[1] = area.y1;
+    command.i[2] = area.x2;
+    command.i[3] = area.y2;
+    command.i[4] = area.getWidth();
+    command.mode = format;
+
+    const char* source = static_cast<const char*>(data);
+    for (int y=0; y < area.getHeight(); ++y) {
+        const size_t offset = mList->copy(source + y * rowLength * pixel, row);
+        if (y == 0) {
+            command.data = offset;
+        }
+    }
+}
+
+void RenderListBackend::setMatrices(const Matrix44f& projection, const Matrix44f& modelView)
+{
+    RenderList::Command& command = mList->add(RenderList::SET_MATRICES);
+    command.data = mList->copy(&projection, sizeof(Matrix44f));
+    mList->copy(&modelView, sizeof(Matrix44f));
+}
+
+void RenderListBackend::pushMatrix(const Vec2f& translate)
+{
+    RenderList::Command& command = mList->add(RenderList::PUSH_MATRIX);
+    command.f[0] = translate.x;
+    command.f[1] = translate.y;
+}
+
+void RenderListBackend::popMatrix()
+{
+    mList->add(RenderList::POP_MATRIX);
+}
+
+void RenderListBackend::color(const ColorA& color)
+{
+    this->color(RenderList::COLOR, color);
+}
+
+void RenderListBackend::clear(const ColorA& color)
+{
+    this->color(RenderList::CLEAR, color);
+}
+
+void RenderListBackend::color(RenderList::CommandType type, const ColorA& color)
+{
+    RenderList::Command& command = mList->add(type);
+    command.f[0] = color.r;
+    command.f[1] = color.g;
+    command.f[2] = color.b;
+    command.f[3] = color.a;
+}
+
+void RenderListBackend::bindShader(gl::GlslProg& shader)
+{
+    mList->add(RenderList::BIND_SHADER, &shader);
+}
+
+void RenderListBackend::unbindShader(gl::GlslProg& shader)
+{
+    mList->add(RenderList::UNBIND_SHADER, &shader);
+}
+
+void RenderListBackend::uniform(gl::GlslProg& shader, const char* name, int value)
+{
+    RenderList::Command& command = mList->add(RenderList::UNIFORM_INT, &shader);
+    command.name = name;
+    command.i[0] = value;
+}
+
+void RenderListBackend::uniform(gl::GlslProg& shader, const char* name, float value)
+{
+    RenderList::Command& command = mList->add(RenderList::UNIFORM_FLOAT, &shader);
+    command.name = name;
+    command.f[0] = value;
+}
+
+void RenderListBackend::uniform(gl::GlslProg& shader, const char* name, const Vec2f& value)
+{
+    RenderList::Command& command = mList->add(RenderList::UNIFORM_VEC2, &shader);
+    command.name = name;
+    command.f[0] = value.x;
+    command.f[1] = value.y;
+}
+
+void RenderListBackend::uniform(gl::GlslProg& shader, const char* name, const ColorA& value)
+{
+    RenderList::Command& command = mList->add(RenderList::UNIFORM_COLOR, &shader);
+    command.name = name;
+    command.f[0] = value.r;
+    command.f[1] = value.g;
+    command.f[2] = value.b;
+    command.f[3] = value.a;
+}
+
+void RenderListBackend::bindTexture(gl::Texture& texture)
+{
+    mList->add(RenderList::BIND_TEXTURE, &texture);
+}
+
+void RenderListBackend::unbindTexture(gl::Texture& texture)
+{
+    mList->add(RenderList::UNBIND_TEXTURE, &texture);
+}
+
+void RenderListBackend::vertexArray(gl::Vbo& vbo, GLint array, GLint components, GLenum type, bool normalize,
+                                    GLsizei stride, size_t offset, GLuint divisor)
+{
+    RenderList::Command& command = mList->add(RenderList::VERTEX_ARRAY, &vbo);
+    command.i[0] = array;
+    command.i[1] = components;
+    command.i[2] = normalize;
+    command.i[3] = stride;
+    command.i[4] = GLint(divisor);
+    command.mode = type;
+    command.offset = offset;
+}
+
+void RenderListBackend::disableArrays()
+{
+    mList->add(RenderList::DISABLE_ARRAYS);
+}
+
+void RenderListBackend::drawElements(gl::Vbo& indices, GLenum mode, GLsizei count, GLenum type, GLsizei instances)
+{
+    RenderList::Command& command = mList->add(RenderList::DRAW_ELEMENTS, &indices);
+    command.mode = mode;
+    command.i[0] = count;
+    command.i[1] = GLint(type);
+    command.i[2] = instances;
+}
+
+void RenderListBackend::drawRect(const Rectf& rect)
+{
+    RenderList::Command& command = mList->add(RenderList::DRAW_RECT);
+    command.f[0] = rect.x1;
+    command.f[1] = rect.y1;
+    command.f[2] = rect.x2;
+    command.f[3] = rect.y2;
+}
+
+void RenderListBackend::drawTexture(gl::Texture& texture, const Vec2f& pos)
+{
+    RenderList::Command& command = mList->add(RenderList::DRAW_TEXTURE, &texture);
+    command.f[0] = pos.x;
+    command.f[1] = pos.y;
+}
+
+RenderPipeline::RenderPipeline(RenderBackendPtr device, bool threaded)
+    : mDevice(device), mRecorder(new RenderListBackend(device)), mFront(0), mThreaded(threaded), mQuit(false)
+{
+    recordScene();
+    if (mThreaded) {
+        mThread = boost::thread(boost::bind(&RenderPipeline::work, this));
+    }
+}
+
+RenderPipeline::~RenderPipeline()
+{
+    if (mThreaded) {
+        {
+            boost::mutex::scoped_lock lock(mMutex);
+            mQuit = true;
+        }
+        mCondition.notify_all();
+        mThread.join();
+    }
+}
+
+void RenderPipeline::recordScene()
+{
+    mRecorder->record(&back().scene);
+}
+
+void RenderPipeline::recordGui()
+{
+    mRecorder->record(&back().gui);
+}
+
+void RenderPipeline::swap()
+{
+    mFront = 1 - mFront;
+    back().scene.clear();
+    back().gui.clear();
+    recordScene();
+}
+
+void RenderPipeline::submitScene()
+{
+    mFrames[mFront].scene.submit(*mDevice);
+}
+
+void RenderPipeline::submitGui()
+{
+    mFrames[mFront].gui.submit(*mDevice);
+}
+
+void RenderPipeline::simulate(const boost::function<void ()>& job)
+{
+    if (!mThreaded) {
+        job();
+        return;
+    }
+
+    boost::mutex::scoped_lock lock(mMutex);
+    while (mJob) {
+        mCondition.wait(lock);
+    }
+    mJob = job;
+    mCondition.notify_all();
+}
+
+void RenderPipeline::wait()
+{
+    if (!mThreaded) {
+        return;
+    }
+
+    boost::mutex::scoped_lock lock(mMutex);
+    while (mJob) {
+        mCondition.wait(lock);
+    }
+}
+
+//  Run jobs until told to quit, finishing any already given
+void RenderPipeline::work()
+{
+    boost::mutex::scoped_lock lock(mMutex);
+    for (;;) {
+        while (!mJob && !mQuit) {
+            mCondition.wait(lock);
+        }
+        if (!mJob) {
+            return;
+        }
+
+        boost::function<void ()> job = mJob;
+        lock.unlock();
+        job();
+        lock.lock();
+        mJob.clear();
+        mCondition.notify_all();
+    }
+}
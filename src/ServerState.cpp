@@ -2,6 +2,7 @@
 
 #include "ServerState.h"
 #include "WarGame.h"
+#include "FrameScheduler.h"
 #include "cinder/Vector.h"
 #include "cinder/Rand.h"
 #include "cinder/gl/gl.h"
@@ -44,6 +45,18 @@ struct ServerConsoleInput : public GuiCallbackGG
             // tell clients to start
             mState.sendStartGame();
         }
+        else if (input.compare(0, 6, ".load ") == 0) {
+            //  Switch maps without a restart, the file is mapped not parsed
+            GuiConsoleOutput cout = GG.console->output();
+            string path = input.substr(6);
+            if (GG.hexMap.load(path)) {
+                Vec2i size = GG.hexMap.getSize();
+                cout << "Loaded map " << path << " (" << size.x << "x" << size.y << ")" << std::endl;
+            }
+            else {
+                cout << "Could not load map " << path << std::endl;
+            }
+        }
         else {
             stringstream ss;
             ss << "SERVER: " << GG.console->getInput() << std::endl; 
@@ -115,6 +128,9 @@ void ServerState::enter()
 
     // physics world
     mPhysics->setup();
+
+    //  Full relabels of big maps are worth spreading over the server's cores
+    GG.hexMap.setLabelThreads(0);
 }
 
 void ServerState::leave()
@@ -148,11 +164,11 @@ static unsigned char GetPacketIdentifier(Packet *p)
 		return (unsigned char) p->data[0];
 }
 
-void ServerState::update()
+void ServerState::tick(float dt)
 {
-    mPhysics->update(0.16666f);
+    mPhysics->update(dt);
 
-    io::stream<GuiConsoleStream> cout = GG.console->output();
+    LogSink& log = GG.console->log();
 
 	Packet* p;
     unsigned char packetIdentifier;
@@ -168,34 +184,34 @@ void ServerState::update()
         {
         case ID_DISCONNECTION_NOTIFICATION:
             // Connection lost normally
-            cout << "ID_DISCONNECTION_NOTIFICATION from " << p->systemAddress.ToString(true) << endl;
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_DISCONNECTION_NOTIFICATION from " << p->systemAddress.ToString(true);
             break;
 
         case ID_NEW_INCOMING_CONNECTION:
             // Somebody connected.  We have their IP now
-            cout << "ID_NEW_INCOMING_CONNECTION from " << p->systemAddress.ToString(true) << " with GUID " << p->guid.ToString() << endl;
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_NEW_INCOMING_CONNECTION from " << p->systemAddress.ToString(true) << " with GUID " << p->guid.ToString();
             clientID=p->systemAddress; // Record the player ID of the client
             break;
 
         case ID_INCOMPATIBLE_PROTOCOL_VERSION:
-            cout << "ID_INCOMPATIBLE_PROTOCOL_VERSION\n";
+            NETPHY_LOG(log, LEVEL_WARNING) << "ID_INCOMPATIBLE_PROTOCOL_VERSION";
             break;
 
         case ID_MODIFIED_PACKET:
             // Cheater!
-            cout << "ID_MODIFIED_PACKET\n";
+            NETPHY_LOG(log, LEVEL_WARNING) << "ID_MODIFIED_PACKET";
             break;
 
         case ID_CONNECTION_LOST:
             // Couldn't deliver a reliable packet - i.e. the other system was abnormally
             // terminated
-            cout << "ID_CONNECTION_LOST from " << p->systemAddress.ToString(true) << endl;
+            NETPHY_LOG(log, LEVEL_INFO) << "ID_CONNECTION_LOST from " << p->systemAddress.ToString(true);
             break;
 
         default:
             // The server knows the static data of all clients, so we can prefix the message
             // With the name data
-            cout << p->data << std::endl;
+            NETPHY_LOG(log, LEVEL_INFO) << (const char*) p->data;
 
             // Relay the message.  We prefix the name for other clients.  This demonstrates
             // That messages can be changed on the server before being broadcast
@@ -205,14 +221,12 @@ void ServerState::update()
             break;
         }
     }
-
-    cout.flush();
 }
 
 void ServerState::draw()
 {
-    gl::clear( Color( 0.25f, 0.4f, 0.25f ) );
-    mPhysics->draw();
+    GG.backend.clear( Color( 0.25f, 0.4f, 0.25f ) );
+    mPhysics->draw(GG.scheduler.getAlpha());
 }
 
 void ServerState::mouseWheel(MouseEvent event)
@@ -232,7 +246,7 @@ void ServerState::keyDown(ci::app::KeyEvent event)
         mManager.setActiveState("title");
     }
     else if (keycode == app::KeyEvent::KEY_BACKQUOTE) {
-        // XXX should push console to the top of the gui widget list
+        //  attaching again brings it to the top
         GG.gui.attach(GG.console);
     }
     else if (keycode == app::KeyEvent::KEY_SPACE) {
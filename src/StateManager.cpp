@@ -48,6 +48,11 @@ void StateManager::setActiveState(std::string stateName)
     mActiveState->enter();
 }
 
+void StateManager::tick(float dt)
+{
+    mActiveState->tick(dt);
+}
+
 void StateManager::update()
 {
     mActiveState->update();
@@ -97,7 +97,7 @@ void TitleState::update()
 
 void TitleState::draw()
 {
-    gl::clear( Color( 0.16f, 0.4f, 0.16f ) );
+    GG.backend.clear( Color( 0.16f, 0.4f, 0.16f ) );
 }
 
 void TitleState::mouseWheel(MouseEvent event)
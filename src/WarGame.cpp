@@ -1,13 +1,22 @@
 #include "WarGame.h"
 #include "StateManager.h"
+#include "HexLabels.h"
+#include "HexCulling.h"
 
 #include "cinder/app/AppBasic.h"
+#include "../Resources.h"
 
-#include "boost/unordered_set.hpp"
-
+#include <algorithm>
 #include <string>
 #include <sstream>
 
+//  Colour buffer spans closer than this many cells are uploaded as one
+static const int SpanMergeGap = 64;
+
+//  Chunk meshes fan each hex into 6 triangles around its centre
+static const int HexVertices = 7;
+static const int HexIndices = 18;
+
 using namespace ci;
 using namespace ci::app;
 using namespace netphy;
@@ -15,11 +24,15 @@ using namespace netphy;
 using std::string;
 using std::vector;
 using boost::shared_ptr;
-using boost::unordered_set;
 
 HexGrid::HexGrid(double xspacing, double yspacing) 
     : mXSpacing(xspacing), mYSpacing(yspacing) { }
 
+Vec2f HexGrid::getSpacing() const
+{
+    return Vec2f(float(mXSpacing), float(mYSpacing));
+}
+
 void HexGrid::setSpacing(double xspacing, double yspacing) 
 {
     mXSpacing = xspacing;
@@ -62,45 +75,26 @@ Vec3f HexGrid::HexToWorld(HexCoord hexPos, bool scale)
     return Vec3f(x, y, 0);
 }
 
+const int HexGrid::NeighbourOffsets[2][HEX_DIRECTIONS][2] = {
+    //  even column
+    { { -1, 0 }, { 0, 1 }, { 1, 0 }, { 1, -1 }, { 0, -1 }, { -1, -1 } },
+    //  odd column
+    { { -1, 1 }, { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, -1 }, { -1, 0 } }
+};
+
 //  Returns neighbours in order nw, n, ne, se, s, sw
 HexAdjacent HexGrid::adjacent(HexCoord pos)
 {
     HexAdjacent result;
-
-    if (pos.x % 2) {
-        // odd column
-        result.nw = HexCoord(pos.x-1, pos.y+1);
-        result.n  = HexCoord(pos.x, pos.y+1);
-        result.ne = HexCoord(pos.x+1, pos.y+1);
-        result.se = HexCoord(pos.x+1, pos.y);
-        result.s  = HexCoord(pos.x, pos.y-1);
-        result.sw = HexCoord(pos.x-1, pos.y);
-    }
-    else {
-        // even column
-        result.nw = HexCoord(pos.x-1, pos.y);
-        result.n  = HexCoord(pos.x, pos.y+1);
-        result.ne = HexCoord(pos.x+1, pos.y);
-        result.se = HexCoord(pos.x+1, pos.y-1);
-        result.s  = HexCoord(pos.x, pos.y-1);
-        result.sw = HexCoord(pos.x-1, pos.y-1);
-    }
-
+    result.nw = neighbour(pos, HEX_NW);
+    result.n  = neighbour(pos, HEX_N);
+    result.ne = neighbour(pos, HEX_NE);
+    result.se = neighbour(pos, HEX_SE);
+    result.s  = neighbour(pos, HEX_S);
+    result.sw = neighbour(pos, HEX_SW);
     return result;
 }
 
-vector<HexCoord> HexAdjacent::toVector()
-{
-    vector<HexCoord> ret;
-    ret.push_back(nw);
-    ret.push_back(n);
-    ret.push_back(ne);
-    ret.push_back(se);
-    ret.push_back(s);
-    ret.push_back(sw);
-    return ret;
-}
-
 string HexAdjacent::toString()
 {
     std::stringstream ss;
@@ -111,114 +105,256 @@ string HexAdjacent::toString()
 }
 
 
-HexCell::HexCell()
-{
-    mLand = 0;
+HexMap::HexMap(HexGrid& grid, int width, int height, bool chunked) 
+    : mHexGrid(grid), mVisitEpoch(0), mLabelThreads(1), mBulkEdit(0), mChunked(chunked)
+{ 
+    mSize.x = width;
+    mSize.y = height;
+    mChunkCount.x = (width + CHUNK_SIZE-1) / CHUNK_SIZE;
+    mChunkCount.y = (height + CHUNK_SIZE-1) / CHUNK_SIZE;
+
+    if (mChunked) {
+        //  only the empty chunk to start with
+        mChunkSlots.assign(mChunkCount.x * mChunkCount.y, 0);
+    }
+    else {
+        for (int chunk=0; chunk < mChunkCount.x * mChunkCount.y; ++chunk) {
+            mResident.push_back(chunk);
+        }
+    }
+
+    //  every chunk starts out changed, for consumers that have seen nothing
+    mRevision = 1;
+    mLayoutRevision = mRevision;
+    mChunkRevisions.assign(mChunkCount.x * mChunkCount.y, mRevision);
+
+    int cells = cellCount();
+    mLand.assign((cells + 31) / 32, 0);
+    mOwners.assign(cells, 0);
+    mColors.assign(cells, Color8u(Color(0.15f, 0.15f, 0.15f)));
+
+    buildNeighbourOffsets();
 }
 
-HexCell::~HexCell()
-{ 
+void HexMap::buildNeighbourOffsets()
+{
+    for (int parity=0; parity < 2; ++parity) {
+        for (int edges=0; edges < 16; ++edges) {
+            const bool west = (edges & 1) != 0, east = (edges & 2) != 0;
+            const bool south = (edges & 4) != 0, north = (edges & 8) != 0;
+
+            for (int d=0; d < HEX_DIRECTIONS; ++d) {
+                const int dx = HexGrid::NeighbourOffsets[parity][d][0];
+                const int dy = HexGrid::NeighbourOffsets[parity][d][1];
+                const bool offMap = (dx < 0 && west) || (dx > 0 && east) || (dy < 0 && south) || (dy > 0 && north);
+                mNeighbourOffsets[parity][edges][d] = offMap ? 0 : dy * mSize.x + dx;
+            }
+        }
+
+        for (int d=0; d < HEX_DIRECTIONS; ++d) {
+            const int dx = HexGrid::NeighbourOffsets[parity][d][0];
+            const int dy = HexGrid::NeighbourOffsets[parity][d][1];
+            mChunkOffsets[parity][d] = dy * CHUNK_SIZE + dx;
+        }
+    }
 }
 
-void HexCell::setPos(HexCoord& pos) 
+//  Forget everything computed from the cells after the map is replaced
+void HexMap::resetDerived()
 {
-    mPos = pos;
+    buildNeighbourOffsets();
+    mLayoutRevision = ++mRevision;
+    mChunkRevisions.assign(mChunkCount.x * mChunkCount.y, mRevision);
+    vector<uint32_t>().swap(mVisited);
+    mVisitEpoch = 0;
+
+    if (mTracker) {
+        mTracker->reset();
+    }
 }
 
-void HexCell::setColor(Color& color) 
+int HexMap::allocate(const HexCoord& pos)
 {
-    mColor = color;
+    if (mChunked && !mChunkSlots[chunkAt(pos)]) {
+        allocateChunk(chunkAt(pos));
+    }
+    return index(pos);
 }
 
-Color& HexCell::getColor()
+//  Give a chunk storage in the next slot, its cells start out as sea
+void HexMap::allocateChunk(int chunk)
 {
-    return mColor;
+    mResident.push_back(chunk);
+    mChunkSlots[chunk] = int(mResident.size());
+    mChunkRevisions[chunk] = ++mRevision;
+
+    const int cells = cellCount();
+    mLand.resize(cells / 32, 0);
+    mOwners.resize(cells, 0);
+    mColors.resize(cells, Color8u(Color(0.15f, 0.15f, 0.15f)));
+
+    if (mTracker) {
+        mTracker->cellsAdded();
+    }
 }
 
-int HexCell::getLand()
+void HexMap::adjacent(const HexCoord& pos, int* out) const
 {
-    return mLand;
+    if (!mChunked) {
+        adjacent(index(pos), out);
+        return;
+    }
+
+    for (int d=0; d < HEX_DIRECTIONS; ++d) {
+        const HexCoord next = HexGrid::neighbour(pos, d);
+        out[d] = isValid(next) ? index(next) : -1;
+    }
 }
 
-void HexCell::setLand(int land)
+HexMap::~HexMap()
 {
-    mLand = land;
 }
 
-int HexCell::getOwner()
+Vec2i HexMap::getSize() const
 {
-    return mOwner;
+    return mSize;
 }
 
-void HexCell::setOwner(int id)
+void HexMap::setLand(int index, bool land)
 {
-    mOwner = id;
+    assert(!mChunked || index >= CHUNK_CELLS);
+    if (isLand(index) == land) {
+        return;
+    }
+
+    uint32_t bit = 1u << (index & 31);
+    if (land) {
+        mLand[index >> 5] |= bit;
+    }
+    else {
+        mLand[index >> 5] &= ~bit;
+    }
+    touch(index);
+    cellChanged(index);
 }
 
-HexMap::HexMap(HexGrid& grid, int width, int height) : mHexGrid(grid)
-{ 
-    mSize.x = width;
-    mSize.y = height;
+void HexMap::setOwner(int index, int owner)
+{
+    assert(!mChunked || index >= CHUNK_CELLS);
+    assert(owner >= 0 && owner < 256);
+    if (mOwners[index] == static_cast<uint8_t>(owner)) {
+        return;
+    }
+
+    mOwners[index] = static_cast<uint8_t>(owner);
+    touch(index);
+    if (isLand(index)) {
+        cellChanged(index);
+    }
+}
 
-    mCells = new HexCell*[width];
-    for (int i=0; i < width; ++i ) {
-        mCells[i] = new HexCell[height];
-        for (int j=0; j < height; ++j) {
-            HexCell& cell = at(HexCoord(i,j));
-            cell.setPos(HexCoord(i,j));
-            cell.setColor(Color(0.15f, 0.15f, 0.15f));
+void HexMap::changedChunks(uint32_t since, vector<int>& out) const
+{
+    for (vector<int>::const_iterator it = mResident.begin(); it != mResident.end(); ++it) {
+        if (mChunkRevisions[*it] > since) {
+            out.push_back(*it);
         }
     }
 }
 
-HexMap::~HexMap()
+void HexMap::cellChanged(int index)
 {
-    for (int i=0; i < mSize.x; ++i) {
-        delete [] mCells[i];
+    if (mTracker && !mBulkEdit) {
+        mTracker->cellChanged(index);
     }
 }
 
-HexCell& HexMap::at(HexCoord& pos)
+vector<HexCoord> HexMap::connected(HexCoord pos)
 {
-    assert(pos.x >=0 && pos.x < mSize.x && pos.y >= 0 && pos.y < mSize.y);
-    return mCells[pos.x][pos.y];
+    vector<HexCoord> result;
+    connected(pos, result);
+    return result;
 }
 
-Vec2i HexMap::getSize()
+void HexMap::connected(const HexCoord& pos, vector<HexCoord>& result)
 {
-    return mSize;
+    //  the start cell may have no storage, so take its neighbours from its position
+    int ring[HEX_DIRECTIONS];
+    adjacent(pos, ring);
+    fill(index(pos), ring, mFill);
+
+    result.clear();
+    result.push_back(pos);
+    for (vector<int>::iterator it = mFill.begin() + 1; it != mFill.end(); ++it) {
+        result.push_back(position(*it));
+    }
 }
 
-//  Check position lies on hex map
-bool HexMap::isValid(HexCoord& pos)
+void HexMap::connected(int start, vector<int>& result)
 {
-    return (pos.x >= 0 && pos.y >= 0 && pos.x < mSize.x && pos.y < mSize.y);
+    int ring[HEX_DIRECTIONS];
+    adjacent(start, ring);
+    fill(start, ring, result);
 }
 
-vector<HexCoord> HexMap::connected(HexCoord pos)
+//  Depth first fill from start, whose neighbours are ring, over land cells with 
+//  the same owner.  The start cell is always included, even if it is sea.
+void HexMap::fill(int start, const int* ring, vector<int>& result)
 {
-    unordered_set<HexCoord> search;
-    unordered_set<HexCoord> checked;
-    std::vector<HexCoord> result;
-
-    int owner = at(pos).getOwner();
-    search.emplace(pos);
-    while (search.begin() != search.end()) {
-        HexCoord check = *(search.begin());
-        if (at(check).getOwner() == owner) {
-            result.push_back(check);            
-            vector<HexCoord> adjacent = mHexGrid.adjacent(check).toVector();
-            for (vector<HexCoord>::iterator it = adjacent.begin(); it != adjacent.end(); ++it) {
-                if (isValid(*it) && checked.find(*it) == checked.end() && at(*it).getLand()) {
-                    search.emplace(*it);
-                }
+    result.clear();
+    mStack.clear();
+
+    const uint32_t epoch = beginVisit();
+    const int owner = getOwner(start);
+
+    //  raw arrays, so stores to the stack and result can't force reloads
+    uint32_t* visited = &mVisited[0];
+    const uint32_t* land = &mLand[0];
+    const uint8_t* owners = &mOwners[0];
+
+    visited[start] = epoch;
+    result.push_back(start);
+    for (int d=0; d < HEX_DIRECTIONS; ++d) {
+        const int next = ring[d];
+        if (next >= 0 && ((land[next >> 5] >> (next & 31)) & 1) && owners[next] == owner && visited[next] != epoch) {
+            visited[next] = epoch;
+            mStack.push_back(next);
+            result.push_back(next);
+        }
+    }
+
+    int neighbours[6];
+    while (!mStack.empty()) {
+        const int cur = mStack.back();
+        mStack.pop_back();
+
+        const int count = this->neighbours(cur, neighbours);
+        for (int i=0; i < count; ++i) {
+            const int next = neighbours[i];
+            if (((land[next >> 5] >> (next & 31)) & 1) && owners[next] == owner && visited[next] != epoch) {
+                visited[next] = epoch;
+                mStack.push_back(next);
+                result.push_back(next);
             }
         }
-        checked.emplace(check);
-        search.erase(check);
     }
+}
 
-    return result;
+//  Start a new flood fill, returns the stamp marking cells visited by it
+uint32_t HexMap::beginVisit()
+{
+    if (mVisited.size() != size_t(cellCount())) {
+        mVisited.assign(cellCount(), 0);
+        mVisitEpoch = 0;
+    }
+
+    if (++mVisitEpoch == 0) {
+        //  stamps wrapped around, forget all previous visits
+        std::fill(mVisited.begin(), mVisited.end(), 0);
+        mVisitEpoch = 1;
+    }
+
+    return mVisitEpoch;
 }
 
 void HexRegion::addHexes(vector<HexCoord>& hexes)
@@ -228,41 +364,104 @@ void HexRegion::addHexes(vector<HexCoord>& hexes)
     }
 }
 
-std::vector<HexRegion> HexMap::regions()
+void HexRegion::clear()
 {
-    unordered_set<HexCoord> search;
-    unordered_set<HexCoord> checked;
-    vector<HexRegion> regions;
+    mHexes.clear();
+}
 
-    HexCoord pos;
-    for (int ix=0; ix < mSize.x; ++ix) {
-        for (int iy=0; iy < mSize.y; ++iy) {
-            pos = HexCoord(ix, iy);
-            if (at(pos).getLand()) {
-                search.emplace(pos);
-            }
-        }
+const HexLabels& HexMap::labelRegions()
+{
+    if (mTracker && !mBulkEdit) {
+        return mTracker->labels();
     }
 
-    while (search.begin() != search.end()) {
-        HexCoord check = *(search.begin());
+    if (!mLabeller) {
+        mLabeller = HexLabellerPtr(new HexLabeller(mLabelThreads));
+        mLabels = boost::shared_ptr<HexLabels>(new HexLabels());
+    }
 
-        vector<HexCoord> conn = connected(check);
-        for (vector<HexCoord>::iterator it = conn.begin(); it != conn.end(); ++it) {
-            search.erase(*it);
-        }
+    mLabeller->label(*this, *mLabels);
+    return *mLabels;
+}
 
-        HexRegion region;
-        region.addHexes(conn);
-        regions.push_back(region);        
+vector<HexRegion> HexMap::regions()
+{
+    const HexLabels& labels = labelRegions();
+
+    vector<HexRegion> regions(labels.regionCount());
+    for (int r=0; r < labels.regionCount(); ++r) {
+        regions[r].hexes().reserve(labels.sizes[r]);
+    }
+
+    const int cells = cellCount();
+    for (int i=0; i < cells; ++i) {
+        const int label = labels.labels[i];
+        if (label >= 0) {
+            regions[label].addHex(position(i));
+        }
+    }
 
-        //  XXX not required, already erased above
-        search.erase(check);
+    //  drop unused labels left by incremental tracking
+    vector<HexRegion>::iterator last = regions.begin();
+    for (int r=0; r < labels.regionCount(); ++r) {
+        if (labels.sizes[r] > 0) {
+            (last++)->hexes().swap(regions[r].hexes());
+        }
     }
+    regions.erase(last, regions.end());
 
     return regions;
 }
 
+void HexMap::setLabelThreads(int threads)
+{
+    mLabelThreads = threads;
+    if (mLabeller) {
+        mLabeller->setThreads(threads);
+    }
+    if (mTracker) {
+        mTracker->labeller().setThreads(threads);
+    }
+}
+
+void HexMap::trackRegions(bool enable)
+{
+    if (enable && !mTracker) {
+        mTracker = HexRegionTrackerPtr(new HexRegionTracker(*this));
+        mTracker->labeller().setThreads(mLabelThreads);
+        mTracker->reset();
+    }
+    else if (!enable) {
+        mTracker.reset();
+    }
+}
+
+void HexMap::subscribe(HexRegionCallbackPtr callback)
+{
+    trackRegions(true);
+    mTracker->subscribe(callback);
+}
+
+void HexMap::unsubscribe(HexRegionCallbackPtr callback)
+{
+    if (mTracker) {
+        mTracker->unsubscribe(callback);
+    }
+}
+
+void HexMap::beginBulkEdit()
+{
+    ++mBulkEdit;
+}
+
+void HexMap::endBulkEdit()
+{
+    assert(mBulkEdit > 0);
+    if (--mBulkEdit == 0 && mTracker) {
+        mTracker->reset();
+    }
+}
+
 //vector<int> HexMap::countHexes()
 //{
 //    vector<int> counts();
@@ -312,9 +511,15 @@ vector<Player>& WarGame::getPlayers()
     return mPlayers;
 }
 
-HexRender::HexRender(HexMap& map)
-    : mHexMap(map), mHexGrid(map.hexGrid())
+HexRender::HexRender(HexMap& map, RenderBackendPtr backend)
+    : mCuller(new HexCuller()), mBackend(backend), mHexMap(map), mHexGrid(map.hexGrid()), mSelectedHex(-1, -1), 
+      mMarkRevision(0), mMarkLayout(0), mChunkCellAttrib(-1), mCanInstance(false), mInstancing(false), 
+      mBufferCapacity(0), mColorRevision(0), mMarkSynced(0), mCanLod(false), mLodDistance(120.0f), 
+      mLodRevision(0)
 {
+    if (!mBackend) {
+        mBackend = RenderBackendPtr(new GlRenderBackend());
+    }
 }
 
 HexRender::~HexRender()
@@ -326,106 +531,543 @@ void HexRender::setup(Vec2i wsize)
     mWindowSize = wsize;
     mHexGrid.setSpacing(1.5, 1.732050807);
 
-    // gl::enableDepthRead();
-    gl::disableDepthRead();
-    // gl::enableDepthWrite();
-	gl::enableAlphaBlending();
+    if (mBackend->hasContext()) {
+        // gl::enableDepthRead();
+        gl::disableDepthRead();
+        // gl::enableDepthWrite();
+        gl::enableAlphaBlending();
+    }
 
+    setupChunks();
     generateMeshes();
+    setupInstancing();
+    setupLod();
+    mClock.start();
 
     mCamera.setAspectRatio((float) mWindowSize.x / mWindowSize.y);
 	mCamera.lookAt( Vec3f( 0, 0, 30.0f ), Vec3f::zero() );
-    mCameraTo = mCamera.getEyePoint();
-
-    gl::Texture::Format format;
-    format.setInternalFormat(GL_RGBA_FLOAT32_ATI);
+    jumpCamera(mCamera.getEyePoint());
 }
 
+//  The hex instanced drawing places at each cell, edge falls from the centre 
+//  to the corners for the fill shader to draw outlines
 void HexRender::generateMeshes()
 {
-    gl::VboMesh::Layout layout;
-    layout.setStaticIndices();
-    layout.setStaticPositions();
+    HexVertex hex[HexVertices];
+    for (int i=0; i < HexVertices; ++i) {
+        hex[i].position = i == 0 ? Vec3f::zero() : Vec3f(float(cos(i*M_PI/3)), float(sin(i*M_PI/3)), 0);
+        hex[i].color = ColorA8u(255, 255, 255, 255);
+        hex[i].edge = i == 0 ? 255 : 0;
+        hex[i].marks = 0;
+    }
+    mBackend->bufferData(mHexVertices, GL_ARRAY_BUFFER, sizeof(hex), hex, GL_STATIC_DRAW);
+}
+
+//  Index buffer for a full chunk of hexes, shared by every chunk mesh, and 
+//  the shader drawing them.  Without the shader chunks are drawn without 
+//  outlines or marks.
+void HexRender::setupChunks()
+{
+    vector<uint16_t> indices;
+    for (int cell=0; cell < HexMap::CHUNK_CELLS; ++cell) {
+        const uint16_t centre = uint16_t(cell * HexVertices);
+        for (int i=1; i < HexVertices; ++i) {
+            indices.push_back(centre);
+            indices.push_back(centre + i);
+            indices.push_back(centre + i % (HexVertices-1) + 1);
+        }
+    }
+
+    mBackend->bufferData(mChunkIndices, GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), &indices[0], GL_STATIC_DRAW);
+
+    mChunkCellAttrib = -1;
+    if (mBackend->hasContext()) {
+        try {
+            mChunkShader = gl::GlslProg(app::loadResource(RES_HEX_CHUNK_VERT), app::loadResource(RES_HEX_FRAG));
+        }
+        catch (gl::GlslProgCompileExc&) {
+            return;
+        }
+    }
+    mChunkCellAttrib = mBackend->attribLocation(mChunkShader, "hexCell");
+}
+
+//  Instanced drawing needs ARB_instanced_arrays and ARB_draw_instanced, 
+//  without them drawHexes falls back to the chunk meshes
+void HexRender::setupInstancing()
+{
+    mCanInstance = false;
+    mInstancing = false;
+    if (!mBackend->hasInstancing()) {
+        return;
+    }
 
-    // XXX switch to 4-triangle hexes
-    mHexMesh = gl::VboMesh(7, 8, layout, GL_TRIANGLE_FAN);
+    if (mBackend->hasContext()) {
+        try {
+            mShader = gl::GlslProg(app::loadResource(RES_HEX_VERT), app::loadResource(RES_HEX_FRAG));
+        }
+        catch (gl::GlslProgCompileExc&) {
+            return;
+        }
+    }
 
-    vector<uint32_t> indices;
-    vector<Vec3f>    positions;
+    mEdgeAttrib = mBackend->attribLocation(mShader, "hexEdge");
+    mColorAttrib = mBackend->attribLocation(mShader, "hexColor");
+    mMarkAttrib = mBackend->attribLocation(mShader, "hexMarks");
+    if (mEdgeAttrib < 0 || mColorAttrib < 0 || mMarkAttrib < 0) {
+        return;
+    }
 
-    for (int i=0; i < 7; ++i) {
-        indices.push_back(i);
-        positions.push_back(i == 0 ? Vec3f(0, 0, 0) : Vec3f(float(cos(i*M_PI/3)), float(sin(i*M_PI/3)), 0));
+    mColorVbo = gl::Vbo();
+    mMarkVbo = gl::Vbo();
+    mBufferCapacity = 0;
+    mCanInstance = true;
+    mInstancing = true;
+}
+
+//  The zoomed out quad needs shaders and a texture as large as the map
+void HexRender::setupLod()
+{
+    mCanLod = false;
+    if (mBackend->hasContext()) {
+        try {
+            mLodShader = gl::GlslProg(app::loadResource(RES_HEX_LOD_VERT), app::loadResource(RES_HEX_LOD_FRAG));
+        }
+        catch (gl::GlslProgCompileExc&) {
+            return;
+        }
     }
-    indices.push_back(1);
 
-    mHexMesh.bufferIndices( indices );
-    mHexMesh.bufferPositions( positions );
+    mLodTexture = gl::Texture();
+    mLodRevision = 0;
+    mCanLod = true;
+}
+
+void HexRender::tick(float dt)
+{
+    //  close 5% of the distance every 60th of a second, whatever the tick rate
+    mCameraFrom = mCameraAt;
+    mCameraAt += (mCameraTo - mCameraAt) * (1.0f - pow(0.95f, dt * 60.0f));
+}
+
+void HexRender::update(float alpha)
+{
+    mCamera.setEyePoint(mCameraFrom + (mCameraAt - mCameraFrom) * alpha);
+    mBackend->setMatrices(mCamera);
+    mCuller->update(mCamera, mHexGrid, mHexMap.getSize());
+}
 
-    mHexOutlineMesh = gl::VboMesh( 7, 6, mHexMesh.getLayout(), GL_LINE_LOOP, NULL, &mHexMesh.getStaticVbo(), NULL );
-    indices.clear();
-    assert(indices.empty());
-    for (int i=1; i < 1+6; ++i) {
-        indices.push_back(i);        
+void HexRender::drawHexes()
+{
+    if (mCanLod && mCamera.getEyePoint().z > mLodDistance && drawLod()) {
+        return;
+    }
+
+    syncMarks();
+
+    if (mInstancing) {
+        drawInstanced();
+    }
+    else {
+        drawChunks();
     }
-    mHexOutlineMesh.bufferIndices( indices );
 }
 
-Vec3f HexRender::raycastHexPlane(float u, float v)
+//  Size the marks to the map, starting afresh when the map is replaced.  
+//  Marks are reapplied whenever cells gain storage, in case they are marked.
+void HexRender::syncMarks()
 {
-    // Calculate camera ray intersection with z=0 hexagon plane 
-    Ray ray = mCamera.generateRay(u, v, mCamera.getAspectRatio());
-    float t = -ray.getOrigin().z / ray.getDirection().z;
-    Vec3f planeHit = ray.calcPosition(t);
-    return planeHit;
+    const size_t cells = mHexMap.cellCount();
+    if (mMarkLayout != mHexMap.getLayoutRevision()) {
+        const Vec2i chunks = mHexMap.getChunkCount();
+        mMarks.assign(cells, 0);
+        mMarkRevisions.assign(chunks.x * chunks.y, ++mMarkRevision);
+        mMarkLayout = mHexMap.getLayoutRevision();
+    }
+    else if (mMarks.size() != cells) {
+        mMarks.resize(cells, 0);
+    }
+    else {
+        return;
+    }
+
+    for (vector<HexCoord>::iterator it = mHighlighted.begin(); it != mHighlighted.end(); ++it) {
+        mark(*it, HEX_HIGHLIGHTED, true);
+    }
+    mark(mSelectedHex, HEX_SELECTED, true);
 }
 
+void HexRender::mark(const HexCoord& pos, uint8_t marks, bool set)
+{
+    if (!mHexMap.isValid(pos) || !mHexMap.isResident(mHexMap.chunkAt(pos))) {
+        return;
+    }
 
-void HexRender::update()
+    const int index = mHexMap.index(pos);
+    const uint8_t cell = set ? mMarks[index] | marks : mMarks[index] & ~marks;
+    if (cell != mMarks[index]) {
+        mMarks[index] = cell;
+        mMarkRevisions[mHexMap.chunkAt(pos)] = ++mMarkRevision;
+    }
+}
+
+void HexRender::setSelectedHex(HexCoord loc)
 {
-    //Vec3f planeHit = raycastHexPlane(mMouseLocNorm.x, mMouseLocNorm.y);
-    //mSelectedHex = mHexGrid.WorldToHex(planeHit);
+    syncMarks();
+    mark(mSelectedHex, HEX_SELECTED, false);
+    mSelectedHex = loc;
+    mark(mSelectedHex, HEX_SELECTED, true);
+}
 
-    gl::setMatrices(mCamera);
-    mTopRight = mHexGrid.WorldToHex(raycastHexPlane(1.0f, 1.0f));
-    mBottomLeft = mHexGrid.WorldToHex(raycastHexPlane(0, 0));
+void HexRender::setHighlight(const vector<HexCoord>& cells)
+{
+    clearHighlight();
+    mHighlighted = cells;
+    for (vector<HexCoord>::iterator it = mHighlighted.begin(); it != mHighlighted.end(); ++it) {
+        mark(*it, HEX_HIGHLIGHTED, true);
+    }
+}
 
-    Vec3f dir = (mCameraTo - mCamera.getEyePoint()) * 0.05f;
-    Vec3f eyePoint = mCamera.getEyePoint();
-    eyePoint += dir;
-    mCamera.setEyePoint(eyePoint);
+void HexRender::clearHighlight()
+{
+    syncMarks();
+    for (vector<HexCoord>::iterator it = mHighlighted.begin(); it != mHighlighted.end(); ++it) {
+        mark(*it, HEX_HIGHLIGHTED, false);
+    }
+    mHighlighted.clear();
 }
 
-void HexRender::drawHexes()
+//  Outline and selection colours for the fill shader, the selection pulses
+void HexRender::setShading(gl::GlslProg& shader)
 {
-    Vec2i mapSize = mHexMap.getSize();
+    const float pulse = 0.5f + 0.5f * float(fabs(sin(2.5 * mClock.getSeconds())));
+    mBackend->uniform(shader, "outlineColor", ColorA(0, 0, 0, 0.5f));
+    mBackend->uniform(shader, "selectColor", ColorA(1.0f, 1.0f, 0, pulse));
+}
 
-    for (int ix=mBottomLeft.x-1; ix <= mTopRight.x+1; ++ix) {
-        for (int iy=mBottomLeft.y-1; iy <= mTopRight.y+1; ++iy) {
+//  Resident chunks holding any visible cell
+void HexRender::findVisibleChunks()
+{
+    mVisibleChunks.clear();
+    if (mCuller->isEmpty()) {
+        return;
+    }
 
-            ColorA cellColor;
-            HexCoord loc(ix, iy);
-            if (!mHexMap.isValid(loc)) {
-                // cellColor = ColorA(0.2, 0.2, 0.2);
-                continue;
+    //  Only chunks under the visible cells' bounds are candidates
+    const HexCoord& min = mCuller->getMin();
+    const HexCoord& max = mCuller->getMax();
+    for (int cy=min.y >> HexMap::CHUNK_SHIFT; cy <= max.y >> HexMap::CHUNK_SHIFT; ++cy) {
+        for (int cx=min.x >> HexMap::CHUNK_SHIFT; cx <= max.x >> HexMap::CHUNK_SHIFT; ++cx) {
+            const HexCoord origin(cx << HexMap::CHUNK_SHIFT, cy << HexMap::CHUNK_SHIFT);
+            const int chunk = mHexMap.chunkAt(origin);
+            if (mHexMap.isResident(chunk) && 
+                mCuller->intersects(origin, origin + HexCoord(HexMap::CHUNK_SIZE-1, HexMap::CHUNK_SIZE-1))) {
+                mVisibleChunks.push_back(chunk);
             }
-            else {
-                cellColor = mHexMap.at(loc).getColor();
+        }
+    }
+}
+
+//  (Re)build the mesh of a chunk from its cells' current colours and marks
+void HexRender::buildChunkMesh(int chunk)
+{
+    const Vec2i size = mHexMap.getSize();
+    const HexCoord origin = mHexMap.chunkOrigin(chunk);
+    const int right = std::min(origin.x + int(HexMap::CHUNK_SIZE), size.x);
+    const int top = std::min(origin.y + int(HexMap::CHUNK_SIZE), size.y);
+
+    mChunkCells.clear();
+    for (int y=origin.y; y < top; ++y) {
+        for (int x=origin.x; x < right; ++x) {
+            mChunkCells.push_back(HexCoord(x, y));
+        }
+    }
+    const size_t cells = mChunkCells.size();
+    mChunkWorld.resize(cells);
+    mHexGrid.HexToWorld(&mChunkCells[0], &mChunkWorld[0], cells);
+
+    //  centre then corners
+    Vec3f corners[HexVertices];
+    for (int i=0; i < HexVertices; ++i) {
+        corners[i] = i == 0 ? Vec3f::zero() : Vec3f(float(cos(i*M_PI/3)), float(sin(i*M_PI/3)), 0);
+    }
+
+    const Color8u* colors = mHexMap.colors();
+    mChunkVertices.resize(cells * HexVertices);
+    for (size_t cell=0; cell < cells; ++cell) {
+        const int index = mHexMap.index(mChunkCells[cell]);
+        const Color8u& color = colors[index];
+        HexVertex* vertex = &mChunkVertices[cell * HexVertices];
+        for (int i=0; i < HexVertices; ++i) {
+            vertex[i].position = mChunkWorld[cell] + corners[i];
+            vertex[i].color = ColorA8u(color.r, color.g, color.b, 255);
+            vertex[i].edge = i == 0 ? 255 : 0;
+            vertex[i].marks = mMarks[index];
+        }
+    }
+
+    ChunkMesh& mesh = mChunkMeshes[chunk];
+    mBackend->bufferData(mesh.vertices, GL_ARRAY_BUFFER, mChunkVertices.size() * sizeof(HexVertex), &mChunkVertices[0], GL_STATIC_DRAW);
+    mesh.cells = int(cells);
+    mesh.revision = mHexMap.chunkRevision(chunk);
+    mesh.markRevision = mMarkRevisions[chunk];
+}
+
+//  Draw the visible chunks, building the meshes of any that changed
+void HexRender::drawChunks()
+{
+    const Vec2i chunkCount = mHexMap.getChunkCount();
+    if (mChunkMeshes.size() != size_t(chunkCount.x * chunkCount.y)) {
+        mChunkMeshes.clear();
+        mChunkMeshes.resize(chunkCount.x * chunkCount.y);
+    }
+
+    findVisibleChunks();
+    if (mVisibleChunks.empty()) {
+        return;
+    }
+    for (vector<int>::iterator it = mVisibleChunks.begin(); it != mVisibleChunks.end(); ++it) {
+        const ChunkMesh& mesh = mChunkMeshes[*it];
+        if (mesh.revision != mHexMap.chunkRevision(*it) || mesh.markRevision != mMarkRevisions[*it]) {
+            buildChunkMesh(*it);
+        }
+    }
+
+    const bool shading = mChunkCellAttrib >= 0;
+    if (shading) {
+        mBackend->bindShader(mChunkShader);
+        setShading(mChunkShader);
+    }
+
+    for (vector<int>::iterator it = mVisibleChunks.begin(); it != mVisibleChunks.end(); ++it) {
+        ChunkMesh& mesh = mChunkMeshes[*it];
+        mBackend->vertexArray(mesh.vertices, RenderBackend::POSITION_ARRAY, 3, GL_FLOAT, false, sizeof(HexVertex), 0);
+        mBackend->vertexArray(mesh.vertices, RenderBackend::COLOR_ARRAY, 4, GL_UNSIGNED_BYTE, true, sizeof(HexVertex), sizeof(Vec3f));
+        if (shading) {
+            mBackend->vertexArray(mesh.vertices, mChunkCellAttrib, 2, GL_UNSIGNED_BYTE, true, sizeof(HexVertex), 
+                                  sizeof(Vec3f) + sizeof(ColorA8u));
+        }
+        mBackend->drawElements(mChunkIndices, GL_TRIANGLES, mesh.cells * HexIndices, GL_UNSIGNED_SHORT);
+    }
+
+    mBackend->disableArrays();
+    if (shading) {
+        mBackend->unbindShader(mChunkShader);
+    }
+}
+
+//  Draw runs of cells straight from the colour buffer.  A plain map draws the 
+//  visible columns of each visible row as a run, or the visible rows whole as 
+//  one run when that at most doubles the cells sent.  A chunked map draws 
+//  each visible resident chunk.  Cells of a run outside the visible columns 
+//  are dropped by the shader.
+void HexRender::drawInstanced()
+{
+    syncBuffers();
+
+    if (mCuller->isEmpty()) {
+        return;
+    }
+    const Vec2i size = mHexMap.getSize();
+    const HexCoord& min = mCuller->getMin();
+    const HexCoord& max = mCuller->getMax();
+
+    mBackend->bindShader(mShader);
+    mBackend->uniform(mShader, "spacing", mHexGrid.getSpacing());
+    mBackend->uniform(mShader, "mapSize", Vec2f(size));
+    mBackend->uniform(mShader, "columns", Vec2f(float(min.x), float(max.x)));
+    setShading(mShader);
+    mBackend->vertexArray(mHexVertices, RenderBackend::POSITION_ARRAY, 3, GL_FLOAT, false, sizeof(HexVertex), 0);
+    mBackend->vertexArray(mHexVertices, mEdgeAttrib, 1, GL_UNSIGNED_BYTE, true, sizeof(HexVertex), 
+                          sizeof(Vec3f) + sizeof(ColorA8u));
+
+    if (!mHexMap.isChunked()) {
+        const int columns = max.x - min.x + 1;
+        if (2 * columns >= size.x) {
+            drawInstances(min.y * size.x, (max.y-min.y+1) * size.x, HexCoord(0, min.y), size.x);
+        }
+        else {
+            for (int y=min.y; y <= max.y; ++y) {
+                drawInstances(y * size.x + min.x, columns, HexCoord(min.x, y), columns);
             }
+        }
+    }
+    else {
+        findVisibleChunks();
+        for (vector<int>::iterator it = mVisibleChunks.begin(); it != mVisibleChunks.end(); ++it) {
+            const HexCoord origin = mHexMap.chunkOrigin(*it);
+            drawInstances(mHexMap.index(origin), HexMap::CHUNK_CELLS, origin, HexMap::CHUNK_SIZE);
+        }
+    }
+
+    mBackend->disableArrays();
+    mBackend->unbindShader(mShader);
+}
+
+//  Draw count cells starting at a cell index, laid out in rows of rowWidth from origin
+void HexRender::drawInstances(int index, int count, const HexCoord& origin, int rowWidth)
+{
+    mBackend->uniform(mShader, "origin", Vec2f(origin));
+    mBackend->uniform(mShader, "rowWidth", float(rowWidth));
+
+    mBackend->vertexArray(mColorVbo, mColorAttrib, 3, GL_UNSIGNED_BYTE, true, 0, index * sizeof(Color8u), 1);
+    mBackend->vertexArray(mMarkVbo, mMarkAttrib, 1, GL_UNSIGNED_BYTE, false, 0, index, 1);
+    mBackend->drawElements(mChunkIndices, GL_TRIANGLES, HexIndices, GL_UNSIGNED_SHORT, count);
+}
+
+//  Cell index spans of a set of chunks into mSpans, sorted and coalesced so 
+//  neighbouring chunks go up together.  A chunk of a chunked map is one span.
+void HexRender::chunkSpans(const vector<int>& chunks)
+{
+    mSpans.clear();
+    const Vec2i size = mHexMap.getSize();
+    for (vector<int>::const_iterator it = chunks.begin(); it != chunks.end(); ++it) {
+        const HexCoord origin = mHexMap.chunkOrigin(*it);
+        if (mHexMap.isChunked()) {
+            const int first = mHexMap.index(origin);
+            mSpans.push_back(std::make_pair(first, first + int(HexMap::CHUNK_CELLS)));
+            continue;
+        }
+
+        const int right = std::min(origin.x + int(HexMap::CHUNK_SIZE), size.x);
+        const int top = std::min(origin.y + int(HexMap::CHUNK_SIZE), size.y);
+        for (int y=origin.y; y < top; ++y) {
+            mSpans.push_back(std::make_pair(y * size.x + origin.x, y * size.x + right));
+        }
+    }
+
+    std::sort(mSpans.begin(), mSpans.end());
+    size_t merged = 0;
+    for (size_t i=1; i < mSpans.size(); ++i) {
+        if (mSpans[i].first <= mSpans[merged].second + SpanMergeGap) {
+            mSpans[merged].second = std::max(mSpans[merged].second, mSpans[i].second);
+        }
+        else {
+            mSpans[++merged] = mSpans[i];
+        }
+    }
+    mSpans.resize(mSpans.empty() ? 0 : merged + 1);
+}
+
+//  Bring the GPU copies of the map's colours and the cell marks up to date.  
+//  Only the cells of chunks changed since the last sync are uploaded, as a 
+//  few contiguous spans.
+void HexRender::syncBuffers()
+{
+    const size_t cells = mHexMap.cellCount();
+    const Color8u* colors = mHexMap.colors();
+
+    if (cells > mBufferCapacity) {
+        //  room to spare, chunked maps grow a chunk at a time
+        mBufferCapacity = std::max(cells, mBufferCapacity * 2);
+        mBackend->bufferData(mColorVbo, GL_ARRAY_BUFFER, mBufferCapacity * sizeof(Color8u), 0, GL_DYNAMIC_DRAW);
+        mBackend->bufferSubData(mColorVbo, 0, cells * sizeof(Color8u), colors);
+        mBackend->bufferData(mMarkVbo, GL_ARRAY_BUFFER, mBufferCapacity, 0, GL_DYNAMIC_DRAW);
+        mBackend->bufferSubData(mMarkVbo, 0, cells, &mMarks[0]);
+        mColorRevision = mHexMap.getRevision();
+        mMarkSynced = mMarkRevision;
+        return;
+    }
 
-            gl::pushMatrices();
-            gl::color(cellColor);
-            gl::translate(mHexGrid.HexToWorld(HexCoord(ix, iy)));
-            gl::draw(mHexMesh);
+    if (mColorRevision != mHexMap.getRevision()) {
+        mChangedChunks.clear();
+        mHexMap.changedChunks(mColorRevision, mChangedChunks);
+        chunkSpans(mChangedChunks);
+        for (vector<std::pair<int, int> >::iterator it = mSpans.begin(); it != mSpans.end(); ++it) {
+            mBackend->bufferSubData(mColorVbo, it->first * sizeof(Color8u), (it->second - it->first) * sizeof(Color8u), colors + it->first);
+        }
+        mColorRevision = mHexMap.getRevision();
+    }
 
-            if (mHexMap.isValid(loc)) {
-                gl::color(ColorA(0, 0, 0, 0.5));
-                gl::draw(mHexOutlineMesh);
+    if (mMarkSynced != mMarkRevision) {
+        mChangedChunks.clear();
+        const vector<int>& chunks = mHexMap.residentChunks();
+        for (vector<int>::const_iterator it = chunks.begin(); it != chunks.end(); ++it) {
+            if (mMarkRevisions[*it] > mMarkSynced) {
+                mChangedChunks.push_back(*it);
             }
+        }
+        chunkSpans(mChangedChunks);
+        for (vector<std::pair<int, int> >::iterator it = mSpans.begin(); it != mSpans.end(); ++it) {
+            mBackend->bufferSubData(mMarkVbo, it->first, it->second - it->first, &mMarks[it->first]);
+        }
+        mMarkSynced = mMarkRevision;
+    }
+}
 
-            gl::popMatrices();
+//  Bring the LOD texture up to date with the map's colours, false if the map 
+//  is too large for one texture
+bool HexRender::syncLodTexture()
+{
+    const Vec2i size = mHexMap.getSize();
+    const GLint maxSize = mBackend->getMaxTextureSize();
+    if (size.x > maxSize || size.y > maxSize) {
+        return false;
+    }
+
+    if (mLodRevision < mHexMap.getLayoutRevision()) {
+        gl::Texture::Format format;
+        format.setInternalFormat(GL_RGBA);
+        format.setMinFilter(GL_NEAREST);
+        format.setMagFilter(GL_NEAREST);
+        format.setWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        mBackend->createTexture(mLodTexture, size.x, size.y, format);
+
+        //  Cells without storage stay clear
+        if (mHexMap.isChunked()) {
+            vector<uint8_t> clear(size.x * size.y * 4, 0);
+            mBackend->textureSubImage(mLodTexture, Area(0, 0, size.x, size.y), size.x, GL_RGBA, &clear[0]);
+        }
+        const vector<int>& chunks = mHexMap.residentChunks();
+        for (vector<int>::const_iterator it = chunks.begin(); it != chunks.end(); ++it) {
+            uploadLodChunk(*it);
         }
     }
+    else if (mLodRevision != mHexMap.getRevision()) {
+        mChangedChunks.clear();
+        mHexMap.changedChunks(mLodRevision, mChangedChunks);
+        for (vector<int>::iterator it = mChangedChunks.begin(); it != mChangedChunks.end(); ++it) {
+            uploadLodChunk(*it);
+        }
+    }
+
+    mLodRevision = mHexMap.getRevision();
+    return true;
+}
+
+//  Copy a chunk's colours into the LOD texture.  Rows of a plain map's 
+//  chunk are a map width apart, a chunked map's a chunk width.
+void HexRender::uploadLodChunk(int chunk)
+{
+    const Vec2i size = mHexMap.getSize();
+    const HexCoord origin = mHexMap.chunkOrigin(chunk);
+    const int width = std::min(int(HexMap::CHUNK_SIZE), size.x - origin.x);
+    const int height = std::min(int(HexMap::CHUNK_SIZE), size.y - origin.y);
+
+    mBackend->textureSubImage(mLodTexture, Area(origin.x, origin.y, origin.x + width, origin.y + height), 
+                              mHexMap.isChunked() ? int(HexMap::CHUNK_SIZE) : size.x, GL_RGB, 
+                              mHexMap.colors() + mHexMap.index(origin));
+}
+
+//  Draw the whole map as one quad covering every hex
+bool HexRender::drawLod()
+{
+    if (!syncLodTexture()) {
+        return false;
+    }
+
+    const Vec2i size = mHexMap.getSize();
+    const Vec2f spacing = mHexGrid.getSpacing();
+
+    mBackend->bindTexture(mLodTexture);
+    mBackend->bindShader(mLodShader);
+    mBackend->uniform(mLodShader, "colors", 0);
+    mBackend->uniform(mLodShader, "spacing", spacing);
+    mBackend->uniform(mLodShader, "mapSize", Vec2f(size));
+    mBackend->drawRect(Rectf(-1.0f, -0.5f * spacing.y, (size.x-1) * spacing.x + 1.0f, size.y * spacing.y));
+    mBackend->unbindShader(mLodShader);
+    mBackend->unbindTexture(mLodTexture);
+    return true;
 }
 
 void HexRender::setCameraTo(Vec3f& cameraTo)
@@ -433,23 +1075,15 @@ void HexRender::setCameraTo(Vec3f& cameraTo)
     mCameraTo = cameraTo;
 }
 
-Camera& HexRender::getCamera()
+void HexRender::jumpCamera(const Vec3f& eye)
 {
-    return mCamera;
+    mCamera.setEyePoint(eye);
+    mCameraTo = mCameraFrom = mCameraAt = eye;
 }
 
-void HexRender::drawSelection()
+Camera& HexRender::getCamera()
 {
-    //  Draw highlighted hex
-    if (mHexMap.isValid(mSelectedHex)) {
-        glLineWidth(3.0f);
-        gl::pushMatrices();
-        gl::color(ColorA(1.0f, 1.0f, 0, 0.5f + 0.5f * float(abs(sin(2.5*app::getElapsedSeconds())))));
-        gl::translate(mHexGrid.HexToWorld(mSelectedHex));
-        gl::draw(mHexOutlineMesh);
-        gl::popMatrices();
-        glLineWidth(1.0f);
-    }
+    return mCamera;
 }
 
 void Mouse::mouseMove(MouseEvent event)
@@ -492,8 +1126,9 @@ void Mouse::mouseWheel(ci::app::MouseEvent event)
 {
 }
 
-Shared::Shared(HexMap& hexmap, HexGrid& hexgrid, HexRender& hexrender, GuiController& gui, GuiFactory& factory, Mouse& mouse, WarGame& wargame, GuiConsolePtr console)
-    : hexMap(hexmap), hexGrid(hexgrid), hexRender(hexrender), gui(gui), guiFactory(factory), mouse(mouse), warGame(wargame), console(console)
+Shared::Shared(HexMap& hexmap, HexGrid& hexgrid, HexRender& hexrender, RenderBackend& backend, GuiController& gui, GuiFactory& factory, Mouse& mouse, HexPicker& picker, FrameScheduler& scheduler, WarGame& wargame, GuiConsolePtr console)
+    : hexMap(hexmap), hexGrid(hexgrid), hexRender(hexrender), backend(backend), gui(gui), guiFactory(factory), mouse(mouse), picker(picker), 
+      scheduler(scheduler), warGame(wargame), console(console)
 {
 }
 